@@ -2,6 +2,7 @@
 #include <vector>
 #include <algorithm>
 #include "MPQ.h"
+#include "../common/FastIO.h"
 
 using namespace std;
 
@@ -40,15 +41,21 @@ bool eventSort(const Event &a, const Event &b) {
 
 
 int main() {
-    int n;
-    cin >> n;   // number of buildings
+    // buffered input and output (see FastIO.h)
+    FastIO::IntReader in;
+    FastIO::TextWriter out;
+
+    int n = 0;
+    in.next(n);   // number of buildings
 
     vector<int> L(n), H(n), R(n);
 
     // Reading buildings: left x, height, right x
     // This part is same as example in the homework document.
     for (int i = 0; i < n; i++) {
-        cin >> L[i] >> H[i] >> R[i];
+        in.next(L[i]);
+        in.next(H[i]);
+        in.next(R[i]);
     }
 
     vector<Event> events;
@@ -80,7 +87,7 @@ int main() {
     int firstX = events[0].x;
 
     if (firstX > 0) {
-        cout << "0 0" << endl;
+        out << "0 0\n";
     }
 
     // Create MPQ object (heap + location array)
@@ -106,7 +113,7 @@ int main() {
 
         // if height changed, skyline changes → print it
         if (newMax != currentMax) {
-            cout << e.x << " " << newMax << endl;
+            out << e.x << ' ' << newMax << '\n';
             currentMax = newMax;
         }
     }
@@ -0,0 +1,149 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/*
+   Arena
+   A memory resource that hands out memory from large slabs by
+   bumping a pointer. Memory goes back to the system only when the
+   arena is released or destroyed, so freeing a whole structure
+   costs one free() per slab.
+
+   Slabs start at FIRST_SLAB bytes and double (up to MAX_SLAB), so a
+   structure of n bytes uses O(log n) slabs. Requests larger than a
+   slab get a slab of their own.
+
+   Deallocated blocks are kept for reuse: request sizes are rounded
+   up to one of four size classes per power of two (at most 25%
+   more), and a freed block goes on the free list of its class,
+   which allocate() tries first. So vectors that keep growing and
+   shrinking under churn reuse each other's old buffers instead of
+   growing the arena. Blocks aligned beyond MIN_ALIGN are not kept.
+
+   allocate() and deallocate() are guarded by a mutex so that several
+   threads can build into one arena (the parallel bulk load does).
+ */
+class Arena : public std::pmr::memory_resource {
+public:
+    Arena() : current(nullptr), remaining(0), nextSlab(FIRST_SLAB) {
+        for (size_t c = 0; c < CLASSES; ++c)
+            freeLists[c] = nullptr;
+    }
+
+    ~Arena() { release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Frees every slab; all memory given out becomes invalid.
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < slabs.size(); ++i)
+            std::free(slabs[i]);
+        slabs.clear();
+        for (size_t c = 0; c < CLASSES; ++c)
+            freeLists[c] = nullptr;
+        current = nullptr;
+        remaining = 0;
+        nextSlab = FIRST_SLAB;
+    }
+
+    // Number of slabs in use.
+    size_t slabCount() const { return slabs.size(); }
+
+private:
+    static const size_t FIRST_SLAB = 64 << 10;   // 64 KB
+    static const size_t MAX_SLAB = 64 << 20;     // 64 MB
+
+    // Smallest block and its alignment (room for the free-list link)
+    static const size_t MIN_ALIGN = alignof(std::max_align_t);
+    static const size_t CLASSES = 4 * 64;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::mutex mutex;
+    std::vector<void*> slabs;
+    char* current;          // free part of the newest slab
+    size_t remaining;
+    size_t nextSlab;        // size of the next slab
+    FreeBlock* freeLists[CLASSES];  // freed blocks by size class
+
+    /* Size class of a request: for 2^k < bytes <= 2^(k+1), class
+       j = 1..4 holds blocks of 2^k + j * 2^(k-2) bytes. */
+    static size_t sizeClass(size_t bytes) {
+        if (bytes < MIN_ALIGN)
+            bytes = MIN_ALIGN;
+        unsigned k = 63 - static_cast<unsigned>(__builtin_clzll(bytes - 1));
+        size_t quarter = size_t(1) << (k - 2);
+        size_t j = (bytes - (size_t(1) << k) + quarter - 1) / quarter;
+        return 4 * k + j - 1;
+    }
+
+    static size_t classSize(size_t c) {
+        unsigned k = static_cast<unsigned>(c / 4);
+        return (size_t(1) << k) + (c % 4 + 1) * (size_t(1) << (k - 2));
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (alignment <= MIN_ALIGN) {
+            size_t c = sizeClass(bytes);
+            if (FreeBlock* block = freeLists[c]) {
+                freeLists[c] = block->next;
+                return block;
+            }
+            bytes = classSize(c);
+            alignment = MIN_ALIGN;
+        }
+
+        size_t pad = (alignment - reinterpret_cast<size_t>(current) % alignment) %
+                     alignment;
+        if (!current || pad + bytes > remaining) {
+            size_t size = nextSlab;
+            if (nextSlab < MAX_SLAB)
+                nextSlab *= 2;
+            if (size < bytes + alignment)
+                size = bytes + alignment;
+
+            void* slab = std::malloc(size);
+            if (!slab)
+                throw std::bad_alloc();
+            slabs.push_back(slab);
+            current = static_cast<char*>(slab);
+            remaining = size;
+            pad = (alignment - reinterpret_cast<size_t>(current) % alignment) %
+                  alignment;
+        }
+
+        void* p = current + pad;
+        current += pad + bytes;
+        remaining -= pad + bytes;
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (alignment > MIN_ALIGN)
+            return;     // left to release()
+
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t c = sizeClass(bytes);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = freeLists[c];
+        freeLists[c] = block;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+#endif
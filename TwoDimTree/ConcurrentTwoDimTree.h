@@ -0,0 +1,337 @@
+#ifndef CONCURRENTTWODIMTREE_H
+#define CONCURRENTTWODIMTREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Arena.h"
+#include "Epoch.h"
+#include "TwoDimTree.h"
+
+/*
+   ConcurrentTwoDimTree
+   The rectangle tree for many reader threads and one writer: point
+   queries run while rectangles are being inserted, without locks.
+   Readers are wait-free; a single thread at a time may insert.
+
+   - Nodes are only ever added. Child pointers are atomic and set
+     once, so a reader sees a child either not at all or complete.
+   - A bucket is a version: an indexed RectBucket that never
+     changes, plus a tail of fixed capacity that only grows. The
+     writer fills the next tail entry, then publishes the new
+     length; readers scan up to the length they see, so they never
+     meet a half-written entry.
+   - When the tail is full, the writer builds a new version
+     (copy-on-write: everything re-indexed into the new RectBucket,
+     a tail of an eighth of that), swaps it in atomically and
+     retires the old one to an EpochReclaimer, which frees it once
+     no reader can still be looking at it. As with RectBucket's own
+     tail, insertion stays amortized O(log m) and a query costs what
+     it does in TwoDimTree.
+
+   Placement is that of a TwoDimTree with the default SplitPolicy;
+   hits may come in another order.
+   Each reader thread queries through a Reader of its own.
+ */
+template <class T>
+class ConcurrentTwoDimTree {
+public:
+    typedef typename TwoDimTree<T>::Coord Coord;
+    typedef typename TwoDimTree<T>::Rectangle Rectangle;
+
+    explicit ConcurrentTwoDimTree(const Rectangle& extent) : count(0) {
+        root = newNode(extent);
+    }
+
+    // No Reader may be in use any more.
+    ~ConcurrentTwoDimTree() {
+        destroy(root);
+    }
+
+    ConcurrentTwoDimTree(const ConcurrentTwoDimTree&) = delete;
+    ConcurrentTwoDimTree& operator=(const ConcurrentTwoDimTree&) = delete;
+
+    /* Inserts R (writer side: one thread at a time). */
+    void insert(const T& R) {
+        Node* node = root;
+        for (;;) {
+            Place p = Tree::VERTICAL;
+            if (Tree::divisible(node->Extent))
+                p = Tree::place(R, node->SplitX, node->SplitY);
+            if (p == Tree::VERTICAL) {
+                add(node->Vertical, RectBucket<T>::BY_TOP, R);
+                break;
+            }
+            if (p == Tree::HORIZONTAL) {
+                add(node->Horizontal, RectBucket<T>::BY_LEFT, R);
+                break;
+            }
+            node = child(node, p);
+        }
+        count.store(count.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+        epochs.advance();
+    }
+
+    /* Number of rectangles inserted so far. */
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    /*
+       Reader
+       A query handle for one thread. Queries see every insert that
+       finished before they started, and any number of those running
+       meanwhile. At most EpochReclaimer::MAX_READERS may exist at a
+       time (the constructor throws TooManyReaders).
+     */
+    class Reader {
+    public:
+        explicit Reader(const ConcurrentTwoDimTree& t)
+            : tree(t), slot(t.epochs.attach()) {}
+
+        ~Reader() { tree.epochs.detach(slot); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // Calls visitor(const T&) for every rectangle containing (x,y).
+        template <class Visitor>
+        void visit(Coord x, Coord y, Visitor&& visitor) {
+            Pin pin(tree.epochs, slot);
+            tree.visit(x, y, visitor);
+        }
+
+        size_t count(Coord x, Coord y) {
+            size_t n = 0;
+            visit(x, y, [&n](const T&) { ++n; });
+            return n;
+        }
+
+        void search(Coord x, Coord y, vector<T>& result) {
+            visit(x, y, [&result](const T& R) { result.push_back(R); });
+        }
+
+    private:
+        const ConcurrentTwoDimTree& tree;
+        size_t slot;
+    };
+
+private:
+    typedef TwoDimTree<T> Tree;
+    typedef typename Tree::Place Place;
+
+    // Smallest tail capacity (as in RectBucket)
+    static const size_t MIN_TAIL = 64;
+
+    /*
+       Version
+       main: indexed rectangles (nullptr if none). Tail entries
+       [0, length) are complete; [length, capacity) belong to the
+       writer. A version owns main and the tail.
+     */
+    struct Version {
+        const RectBucket<T>* main;
+        typename RectBucket<T>::SortKey key;
+        size_t capacity;
+        atomic<size_t> length;
+        vector<Coord> Top;          // sized to capacity up front,
+        vector<Coord> Left;         // never reallocated
+        vector<Coord> Bottom;
+        vector<Coord> Right;
+        T* items;                   // raw storage for capacity items
+
+        Version(const RectBucket<T>* m, typename RectBucket<T>::SortKey k,
+                size_t cap)
+            : main(m), key(k), capacity(cap), length(0),
+              Top(cap), Left(cap), Bottom(cap), Right(cap),
+              items(allocator<T>().allocate(cap)) {}
+
+        ~Version() {
+            size_t n = length.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < n; ++i)
+                items[i].~T();
+            allocator<T>().deallocate(items, capacity);
+            delete main;
+        }
+
+        // Query view of the published part of the tail.
+        typename RectBucket<T>::View tail() const {
+            typename RectBucket<T>::View v;
+            v.key = key;
+            v.slots = length.load(std::memory_order_acquire);
+            v.indexedCount = 0;
+            v.base.top = Top.data();
+            v.base.left = Left.data();
+            v.base.bottom = Bottom.data();
+            v.base.right = Right.data();
+            v.base.index = nullptr;
+            v.byStart = v.byEnd = v.base;
+            v.items = items;
+            v.ids = nullptr;
+            v.nodes = nullptr;
+            v.nodeCount = 0;
+            return v;
+        }
+    };
+
+    // Center lines are always the midpoints (the default SplitPolicy).
+    struct Node {
+        Rectangle Extent;
+        Coord SplitX;
+        Coord SplitY;
+        atomic<Version*> Vertical;
+        atomic<Version*> Horizontal;
+        atomic<Node*> TopLeft;
+        atomic<Node*> TopRight;
+        atomic<Node*> BottomLeft;
+        atomic<Node*> BottomRight;
+
+        explicit Node(const Rectangle& e)
+            : Extent(e), SplitX(CoordTraits<Coord>::mid(e.Left, e.Right)),
+              SplitY(CoordTraits<Coord>::mid(e.Top, e.Bottom)),
+              Vertical(nullptr), Horizontal(nullptr),
+              TopLeft(nullptr), TopRight(nullptr),
+              BottomLeft(nullptr), BottomRight(nullptr) {}
+    };
+
+    /* Keeps a reader's epoch announced for the length of a query. */
+    struct Pin {
+        EpochReclaimer& epochs;
+        size_t slot;
+
+        Pin(EpochReclaimer& e, size_t s) : epochs(e), slot(s) { epochs.enter(slot); }
+        ~Pin() { epochs.leave(slot); }
+    };
+
+    Arena arena;                        // nodes (never freed before the tree)
+    Node* root;
+    atomic<size_t> count;
+    mutable EpochReclaimer epochs;      // replaced versions
+
+    Node* newNode(const Rectangle& e) {
+        void* p = arena.allocate(sizeof(Node), alignof(Node));
+        return new (p) Node(e);
+    }
+
+    /* Child of node for quadrant q, published once complete. */
+    Node* child(Node* node, Place q) {
+        atomic<Node*>* slot;
+        switch (q) {
+        case Tree::TOP_LEFT:    slot = &node->TopLeft; break;
+        case Tree::TOP_RIGHT:   slot = &node->TopRight; break;
+        case Tree::BOTTOM_LEFT: slot = &node->BottomLeft; break;
+        default:                slot = &node->BottomRight; break;
+        }
+
+        Node* c = slot->load(std::memory_order_relaxed);
+        if (!c) {
+            c = newNode(Tree::quadrant(node->Extent, node->SplitX,
+                                       node->SplitY, q));
+            slot->store(c, std::memory_order_release);
+        }
+        return c;
+    }
+
+    /*
+       Adds R to bucket: appended to the tail of the current version,
+       or, if that is full (or there is none yet), to a new version
+       built from all of the old one's rectangles.
+     */
+    void add(atomic<Version*>& bucket, typename RectBucket<T>::SortKey key,
+             const T& R) {
+        Version* v = bucket.load(std::memory_order_relaxed);
+        if (!v || v->length.load(std::memory_order_relaxed) == v->capacity) {
+            Version* old = v;
+            v = rebuild(old, key);
+            bucket.store(v, std::memory_order_release);
+            if (old)
+                epochs.retire(old);
+        }
+
+        size_t n = v->length.load(std::memory_order_relaxed);
+        v->Top[n] = R.Top;
+        v->Left[n] = R.Left;
+        v->Bottom[n] = R.Bottom;
+        v->Right[n] = R.Right;
+        new (v->items + n) T(R);
+        v->length.store(n + 1, std::memory_order_release);
+    }
+
+    /* A new version holding every rectangle of old in its main part. */
+    static Version* rebuild(const Version* old,
+                            typename RectBucket<T>::SortKey key) {
+        vector<T> all;
+        if (old) {
+            size_t n = old->length.load(std::memory_order_relaxed);
+            all.reserve((old->main ? old->main->size() : 0) + n);
+            if (old->main)
+                for (size_t i = 0; i < old->main->size(); ++i)
+                    all.push_back(old->main->item(i));
+            all.insert(all.end(), old->items, old->items + n);
+        }
+
+        RectBucket<T>* main = nullptr;
+        if (!all.empty()) {
+            main = new RectBucket<T>(key);
+            vector<uint32_t> ids(all.size(), 0);    // no handles here
+            main->addAll(all.data(), ids.data(), all.size());
+        }
+        size_t capacity = all.size() / 8;
+        if (capacity < MIN_TAIL)
+            capacity = MIN_TAIL;
+        return new Version(main, key, capacity);
+    }
+
+    template <class Visitor>
+    static void visitVersion(const atomic<Version*>& bucket,
+                             Coord x, Coord y, Visitor& visitor) {
+        const Version* v = bucket.load(std::memory_order_acquire);
+        if (!v) return;
+        if (v->main)
+            v->main->visitContaining(x, y, visitor);
+        v->tail().visitContaining(x, y, visitor);
+    }
+
+    /* The descent of TwoDimTree::visit over the published state. */
+    template <class Visitor>
+    void visit(Coord x, Coord y, Visitor& visitor) const {
+        const Node* node = root;
+        while (node) {
+            visitVersion(node->Vertical, x, y, visitor);
+            visitVersion(node->Horizontal, x, y, visitor);
+
+            Coord centerX = node->SplitX;
+            Coord centerY = node->SplitY;
+            if (x == centerX || y == centerY)
+                return;
+
+            const atomic<Node*>* next;
+            if (x < centerX && y < centerY)
+                next = &node->TopLeft;
+            else if (x > centerX && y < centerY)
+                next = &node->TopRight;
+            else if (x < centerX && y > centerY)
+                next = &node->BottomLeft;
+            else
+                next = &node->BottomRight;
+            node = next->load(std::memory_order_acquire);
+        }
+    }
+
+    /* Frees the current versions (nodes go with the arena, retired
+       versions with the reclaimer). */
+    void destroy(Node* node) {
+        if (!node) return;
+
+        delete node->Vertical.load(std::memory_order_relaxed);
+        delete node->Horizontal.load(std::memory_order_relaxed);
+
+        destroy(node->TopLeft.load(std::memory_order_relaxed));
+        destroy(node->TopRight.load(std::memory_order_relaxed));
+        destroy(node->BottomLeft.load(std::memory_order_relaxed));
+        destroy(node->BottomRight.load(std::memory_order_relaxed));
+    }
+};
+
+#endif
@@ -0,0 +1,475 @@
+#ifndef CONTAINSKERNEL_H
+#define CONTAINSKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONTAINSKERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+   ContainsKernel
+   Batch point-in-rectangle test over structure-of-arrays storage
+   (one array per coordinate, as in RectBucket).
+
+   containsMask(top, left, bottom, right, n, x, y, masks) sets bit i
+   of the bitmask (masks[i / 64], bit i % 64) when rectangle i
+   contains (x,y), with Right and Bottom edges excluded.
+
+   Each coordinate type gets its own versions, chosen at compile
+   time by overloading; among those, the best one the running CPU
+   supports is picked on first use. All produce identical masks:
+
+     coordinate   versions (rectangles per compare)
+     int          avx2 (8), sse2 (4)
+     int16_t      avx2 (16), sse2 (8)
+     int64_t      avx2 (4)
+     float        avx (8), sse (4)
+     others       scalar only (also the choice on non-x86 targets)
+
+   Narrower coordinates mean more rectangles per compare and per
+   cache line. A float rectangle with a NaN edge contains no point.
+ */
+namespace ContainsKernel {
+
+template <class C>
+using MaskFunction = void (*)(const C* top, const C* left,
+                              const C* bottom, const C* right,
+                              size_t n, C x, C y, uint64_t* masks);
+
+// Index of the lowest set bit of a non-zero mask.
+inline unsigned lowestBit(uint64_t bits) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+    unsigned i = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// Clears the mask words for n rectangles.
+inline void clearMasks(size_t n, uint64_t* masks) {
+    for (size_t w = 0; w < (n + 63) / 64; ++w)
+        masks[w] = 0;
+}
+
+// Scalar test of rectangles [from, n); also the tail of the SIMD versions.
+template <class C>
+inline void maskScalarFrom(const C* top, const C* left,
+                           const C* bottom, const C* right,
+                           size_t from, size_t n, C x, C y,
+                           uint64_t* masks) {
+    for (size_t i = from; i < n; ++i) {
+        if (left[i] <= x && x < right[i] && top[i] <= y && y < bottom[i])
+            masks[i / 64] |= 1ull << (i % 64);
+    }
+}
+
+template <class C>
+inline void maskScalar(const C* top, const C* left,
+                       const C* bottom, const C* right,
+                       size_t n, C x, C y, uint64_t* masks) {
+    clearMasks(n, masks);
+    maskScalarFrom(top, left, bottom, right, 0, n, x, y, masks);
+}
+
+/* ---- int ---- */
+
+#if defined(CONTAINSKERNEL_X86) && defined(__SSE2__)
+// Hit lanes of 4 rectangles starting at i, one bit per rectangle.
+inline unsigned maskSSE2Block(const int* top, const int* left,
+                              const int* bottom, const int* right,
+                              size_t i, __m128i vx, __m128i vy) {
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+    __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+
+    // left <= x is !(left > x); x < right is right > x
+    __m128i inX = _mm_andnot_si128(_mm_cmpgt_epi32(l, vx),
+                                   _mm_cmpgt_epi32(r, vx));
+    __m128i inY = _mm_andnot_si128(_mm_cmpgt_epi32(t, vy),
+                                   _mm_cmpgt_epi32(b, vy));
+    return static_cast<unsigned>(
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(inX, inY))));
+}
+
+inline void maskSSE2(const int* top, const int* left,
+                     const int* bottom, const int* right,
+                     size_t n, int x, int y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m128i vx = _mm_set1_epi32(x);
+    __m128i vy = _mm_set1_epi32(y);
+
+    // 8 rectangles per iteration; 64 is a multiple of 8, so a
+    // group never straddles two mask words
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t bits = maskSSE2Block(top, left, bottom, right, i, vx, vy) |
+                        maskSSE2Block(top, left, bottom, right, i + 4, vx, vy) << 4;
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+#if defined(CONTAINSKERNEL_X86)
+// Hit lanes of 8 rectangles starting at i, one bit per rectangle.
+__attribute__((target("avx2")))
+inline unsigned maskAVX2Block(const int* top, const int* left,
+                              const int* bottom, const int* right,
+                              size_t i, __m256i vx, __m256i vy) {
+    __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+    __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + i));
+
+    __m256i inX = _mm256_andnot_si256(_mm256_cmpgt_epi32(l, vx),
+                                      _mm256_cmpgt_epi32(r, vx));
+    __m256i inY = _mm256_andnot_si256(_mm256_cmpgt_epi32(t, vy),
+                                      _mm256_cmpgt_epi32(b, vy));
+    return static_cast<unsigned>(
+        _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(inX, inY))));
+}
+
+__attribute__((target("avx2")))
+inline void maskAVX2(const int* top, const int* left,
+                     const int* bottom, const int* right,
+                     size_t n, int x, int y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m256i vx = _mm256_set1_epi32(x);
+    __m256i vy = _mm256_set1_epi32(y);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint64_t bits = maskAVX2Block(top, left, bottom, right, i, vx, vy) |
+                        maskAVX2Block(top, left, bottom, right, i + 8, vx, vy) << 8;
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+/* ---- int16_t ---- */
+
+#if defined(CONTAINSKERNEL_X86) && defined(__SSE2__)
+// Hit lanes (all ones or zero) of 8 rectangles starting at i.
+inline __m128i hitsSSE2(const int16_t* top, const int16_t* left,
+                        const int16_t* bottom, const int16_t* right,
+                        size_t i, __m128i vx, __m128i vy) {
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+    __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+
+    __m128i inX = _mm_andnot_si128(_mm_cmpgt_epi16(l, vx),
+                                   _mm_cmpgt_epi16(r, vx));
+    __m128i inY = _mm_andnot_si128(_mm_cmpgt_epi16(t, vy),
+                                   _mm_cmpgt_epi16(b, vy));
+    return _mm_and_si128(inX, inY);
+}
+
+inline void maskSSE2(const int16_t* top, const int16_t* left,
+                     const int16_t* bottom, const int16_t* right,
+                     size_t n, int16_t x, int16_t y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m128i vx = _mm_set1_epi16(x);
+    __m128i vy = _mm_set1_epi16(y);
+
+    // Two blocks narrowed to one byte per lane, in order
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i lanes = _mm_packs_epi16(hitsSSE2(top, left, bottom, right, i, vx, vy),
+                                        hitsSSE2(top, left, bottom, right, i + 8, vx, vy));
+        uint64_t bits = static_cast<unsigned>(_mm_movemask_epi8(lanes));
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+#if defined(CONTAINSKERNEL_X86)
+// Hit lanes of 16 rectangles starting at i.
+__attribute__((target("avx2")))
+inline __m256i hitsAVX2(const int16_t* top, const int16_t* left,
+                        const int16_t* bottom, const int16_t* right,
+                        size_t i, __m256i vx, __m256i vy) {
+    __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+    __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + i));
+
+    __m256i inX = _mm256_andnot_si256(_mm256_cmpgt_epi16(l, vx),
+                                      _mm256_cmpgt_epi16(r, vx));
+    __m256i inY = _mm256_andnot_si256(_mm256_cmpgt_epi16(t, vy),
+                                      _mm256_cmpgt_epi16(b, vy));
+    return _mm256_and_si256(inX, inY);
+}
+
+__attribute__((target("avx2")))
+inline void maskAVX2(const int16_t* top, const int16_t* left,
+                     const int16_t* bottom, const int16_t* right,
+                     size_t n, int16_t x, int16_t y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m256i vx = _mm256_set1_epi16(x);
+    __m256i vy = _mm256_set1_epi16(y);
+
+    // Packing works per 128-bit half (a0-7 b0-7 a8-15 b8-15);
+    // swapping the middle quarters restores the order
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i lanes = _mm256_packs_epi16(hitsAVX2(top, left, bottom, right, i, vx, vy),
+                                           hitsAVX2(top, left, bottom, right, i + 16, vx, vy));
+        lanes = _mm256_permute4x64_epi64(lanes, 0xD8);
+        uint64_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(lanes));
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+/* ---- int64_t ---- */
+
+#if defined(CONTAINSKERNEL_X86)
+// Hit lanes of 4 rectangles starting at i, one bit per rectangle.
+__attribute__((target("avx2")))
+inline unsigned maskAVX2Block(const int64_t* top, const int64_t* left,
+                              const int64_t* bottom, const int64_t* right,
+                              size_t i, __m256i vx, __m256i vy) {
+    __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+    __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + i));
+
+    __m256i inX = _mm256_andnot_si256(_mm256_cmpgt_epi64(l, vx),
+                                      _mm256_cmpgt_epi64(r, vx));
+    __m256i inY = _mm256_andnot_si256(_mm256_cmpgt_epi64(t, vy),
+                                      _mm256_cmpgt_epi64(b, vy));
+    return static_cast<unsigned>(
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_and_si256(inX, inY))));
+}
+
+__attribute__((target("avx2")))
+inline void maskAVX2(const int64_t* top, const int64_t* left,
+                     const int64_t* bottom, const int64_t* right,
+                     size_t n, int64_t x, int64_t y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m256i vx = _mm256_set1_epi64x(x);
+    __m256i vy = _mm256_set1_epi64x(y);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t bits = maskAVX2Block(top, left, bottom, right, i, vx, vy) |
+                        maskAVX2Block(top, left, bottom, right, i + 4, vx, vy) << 4;
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+/* ---- float ---- */
+
+#if defined(CONTAINSKERNEL_X86) && defined(__SSE2__)
+// Hit lanes of 4 rectangles starting at i, one bit per rectangle.
+inline unsigned maskSSEBlock(const float* top, const float* left,
+                             const float* bottom, const float* right,
+                             size_t i, __m128 vx, __m128 vy) {
+    __m128 inX = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(left + i), vx),
+                            _mm_cmplt_ps(vx, _mm_loadu_ps(right + i)));
+    __m128 inY = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(top + i), vy),
+                            _mm_cmplt_ps(vy, _mm_loadu_ps(bottom + i)));
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_and_ps(inX, inY)));
+}
+
+inline void maskSSE(const float* top, const float* left,
+                    const float* bottom, const float* right,
+                    size_t n, float x, float y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m128 vx = _mm_set1_ps(x);
+    __m128 vy = _mm_set1_ps(y);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t bits = maskSSEBlock(top, left, bottom, right, i, vx, vy) |
+                        maskSSEBlock(top, left, bottom, right, i + 4, vx, vy) << 4;
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+#if defined(CONTAINSKERNEL_X86)
+// Hit lanes of 8 rectangles starting at i, one bit per rectangle.
+// Ordered compares: false for NaN, like the scalar test.
+__attribute__((target("avx")))
+inline unsigned maskAVXBlock(const float* top, const float* left,
+                             const float* bottom, const float* right,
+                             size_t i, __m256 vx, __m256 vy) {
+    __m256 inX = _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(left + i), vx, _CMP_LE_OQ),
+        _mm256_cmp_ps(vx, _mm256_loadu_ps(right + i), _CMP_LT_OQ));
+    __m256 inY = _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(top + i), vy, _CMP_LE_OQ),
+        _mm256_cmp_ps(vy, _mm256_loadu_ps(bottom + i), _CMP_LT_OQ));
+    return static_cast<unsigned>(_mm256_movemask_ps(_mm256_and_ps(inX, inY)));
+}
+
+__attribute__((target("avx")))
+inline void maskAVX(const float* top, const float* left,
+                    const float* bottom, const float* right,
+                    size_t n, float x, float y, uint64_t* masks) {
+    clearMasks(n, masks);
+    __m256 vx = _mm256_set1_ps(x);
+    __m256 vy = _mm256_set1_ps(y);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint64_t bits = maskAVXBlock(top, left, bottom, right, i, vx, vy) |
+                        maskAVXBlock(top, left, bottom, right, i + 8, vx, vy) << 8;
+        masks[i / 64] |= bits << (i % 64);
+    }
+    maskScalarFrom(top, left, bottom, right, i, n, x, y, masks);
+}
+#endif
+
+/* ---- selection ---- */
+
+/*
+   Versions<C>
+   best(): the fastest version for C this CPU supports;
+   name(f): "avx2", "avx", "sse2", "sse" or "scalar".
+ */
+template <class C>
+struct Versions {
+    static MaskFunction<C> best() { return maskScalar<C>; }
+    static const char* name(MaskFunction<C>) { return "scalar"; }
+};
+
+#if defined(CONTAINSKERNEL_X86)
+inline bool hasAVX2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+inline bool hasAVX() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+}
+
+template <>
+struct Versions<int> {
+    static MaskFunction<int> best() {
+        if (hasAVX2())
+            return maskAVX2;
+#if defined(__SSE2__)
+        return maskSSE2;
+#else
+        return maskScalar<int>;
+#endif
+    }
+
+    static const char* name(MaskFunction<int> f) {
+        if (f == static_cast<MaskFunction<int> >(maskAVX2))
+            return "avx2";
+#if defined(__SSE2__)
+        if (f == static_cast<MaskFunction<int> >(maskSSE2))
+            return "sse2";
+#endif
+        return "scalar";
+    }
+};
+
+template <>
+struct Versions<int16_t> {
+    static MaskFunction<int16_t> best() {
+        if (hasAVX2())
+            return maskAVX2;
+#if defined(__SSE2__)
+        return maskSSE2;
+#else
+        return maskScalar<int16_t>;
+#endif
+    }
+
+    static const char* name(MaskFunction<int16_t> f) {
+        if (f == static_cast<MaskFunction<int16_t> >(maskAVX2))
+            return "avx2";
+#if defined(__SSE2__)
+        if (f == static_cast<MaskFunction<int16_t> >(maskSSE2))
+            return "sse2";
+#endif
+        return "scalar";
+    }
+};
+
+template <>
+struct Versions<int64_t> {
+    static MaskFunction<int64_t> best() {
+        if (hasAVX2())
+            return maskAVX2;
+        return maskScalar<int64_t>;
+    }
+
+    static const char* name(MaskFunction<int64_t> f) {
+        return f == static_cast<MaskFunction<int64_t> >(maskAVX2) ? "avx2"
+                                                                  : "scalar";
+    }
+};
+
+template <>
+struct Versions<float> {
+    static MaskFunction<float> best() {
+        if (hasAVX())
+            return maskAVX;
+#if defined(__SSE2__)
+        return maskSSE;
+#else
+        return maskScalar<float>;
+#endif
+    }
+
+    static const char* name(MaskFunction<float> f) {
+        if (f == static_cast<MaskFunction<float> >(maskAVX))
+            return "avx";
+#if defined(__SSE2__)
+        if (f == static_cast<MaskFunction<float> >(maskSSE))
+            return "sse";
+#endif
+        return "scalar";
+    }
+};
+#endif
+
+template <class C>
+inline MaskFunction<C> selectedMask() {
+    static const MaskFunction<C> selected = Versions<C>::best();
+    return selected;
+}
+
+// Name of the version in use for coordinates of type C.
+template <class C = int>
+inline const char* name() {
+    return Versions<C>::name(selectedMask<C>());
+}
+
+/*
+   containsMask
+   Fills masks[0 .. (n + 63) / 64) with the hit bits of rectangles
+   [0, n) for point (x,y).
+ */
+template <class C>
+inline void containsMask(const C* top, const C* left,
+                         const C* bottom, const C* right,
+                         size_t n, C x, C y, uint64_t* masks) {
+    selectedMask<C>()(top, left, bottom, right, n, x, y, masks);
+}
+
+} // namespace ContainsKernel
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TooManyReaders {};
+
+/*
+   EpochReclaimer
+   Epoch-based memory reclamation for one writer and many readers.
+
+   The writer unlinks an object, hands it to retire() and calls
+   advance() once the update is published. A reader announces the
+   current epoch in its slot before touching shared data (enter) and
+   clears the slot afterwards (leave); both are a couple of plain
+   stores, so readers never wait. A retired object is freed once
+   every reader inside a read section entered after it was retired:
+   such readers cannot reach it any more.
+
+   Readers first claim a slot of their own with attach();
+   MAX_READERS slots exist, each on its own cache line.
+ */
+class EpochReclaimer {
+public:
+    static const size_t MAX_READERS = 128;
+
+    EpochReclaimer() : epoch(1) {
+        for (size_t i = 0; i < MAX_READERS; ++i)
+            slots[i].value.store(FREE, std::memory_order_relaxed);
+    }
+
+    // Frees everything retired; no reader may be active any more.
+    ~EpochReclaimer() {
+        for (size_t i = 0; i < retired.size(); ++i)
+            retired[i].destroy(retired[i].object);
+    }
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    /* ---- reader side ---- */
+
+    // Claims a free slot; throws TooManyReaders if there is none.
+    size_t attach() {
+        for (size_t i = 0; i < MAX_READERS; ++i) {
+            uint64_t expected = FREE;
+            if (slots[i].value.compare_exchange_strong(expected, IDLE))
+                return i;
+        }
+        throw TooManyReaders();
+    }
+
+    void detach(size_t slot) {
+        slots[slot].value.store(FREE, std::memory_order_release);
+    }
+
+    void enter(size_t slot) {
+        slots[slot].value.store(epoch.load(std::memory_order_acquire),
+                                std::memory_order_relaxed);
+        // The announcement must be visible before any shared load
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void leave(size_t slot) {
+        slots[slot].value.store(IDLE, std::memory_order_release);
+    }
+
+    /* ---- writer side ---- */
+
+    // Schedules delete p (p must be unlinked already).
+    template <class X>
+    void retire(const X* p) {
+        Retired r = { epoch.load(std::memory_order_relaxed), p, &destroyAs<X> };
+        retired.push_back(r);
+    }
+
+    /* Starts a new epoch (call after publishing an update) and,
+       every RECLAIM_BATCH retirements, frees what is safe. */
+    void advance() {
+        epoch.store(epoch.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+        if (retired.size() >= RECLAIM_BATCH)
+            reclaim();
+    }
+
+    // Frees every retired object that no reader can still reach.
+    void reclaim() {
+        // Pairs with the fence in enter (unlink, then read the slots)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        uint64_t oldest = IDLE;
+        for (size_t i = 0; i < MAX_READERS; ++i) {
+            uint64_t e = slots[i].value.load(std::memory_order_acquire);
+            if (e < oldest)
+                oldest = e;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch < oldest)
+                retired[i].destroy(retired[i].object);
+            else
+                retired[kept++] = retired[i];
+        }
+        retired.resize(kept);
+    }
+
+    // Objects waiting to be freed.
+    size_t pending() const { return retired.size(); }
+
+private:
+    static const uint64_t FREE = UINT64_MAX;        // slot not claimed
+    static const uint64_t IDLE = UINT64_MAX - 1;    // claimed, not reading
+    static const size_t RECLAIM_BATCH = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value;    // epoch of the read in progress
+    };
+
+    struct Retired {
+        uint64_t epoch;                 // epoch when it was retired
+        const void* object;
+        void (*destroy)(const void*);
+    };
+
+    template <class X>
+    static void destroyAs(const void* p) { delete static_cast<const X*>(p); }
+
+    std::atomic<uint64_t> epoch;
+    Slot slots[MAX_READERS];
+    std::vector<Retired> retired;
+};
+
+#endif
@@ -0,0 +1,508 @@
+#ifndef TWODIMSNAPSHOT_H
+#define TWODIMSNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TwoDimTree.h"
+
+/*
+   TwoDimSnapshot
+   A built TwoDimTree saved as one flat, pointer-free image that is
+   mapped read-only and queried in place: no parsing and no building
+   at startup, and processes that map the same file share its pages.
+
+   File layout (native byte order and sizes, so a snapshot is read
+   by the build that wrote it):
+
+     SnapshotHeader
+     SnapshotNode[nodeCount]      tree nodes in preorder, root first;
+                                  children by index (-1 if none)
+     bucket arrays                for each node, Vertical then
+                                  Horizontal, see BucketLayout
+
+   A bucket's arrays are those of RectBucket, one after the other
+   (each starting on an 8-byte boundary), so queries run the same
+   RectBucket::View code over them and report hits in the same order
+   as the tree they were written from.
+
+   T is stored byte for byte: it has to be trivially copyable.
+ */
+template <class T>
+class TwoDimSnapshot {
+    static_assert(is_trivially_copyable<T>::value,
+                  "snapshot items are stored byte for byte");
+    static_assert(alignof(T) <= 8, "snapshot arrays are 8-byte aligned");
+
+public:
+    typedef typename TwoDimTree<T>::Coord Coord;
+    typedef typename TwoDimTree<T>::Rectangle Rectangle;
+
+    /* Maps the snapshot at path; check the result with operator bool. */
+    explicit TwoDimSnapshot(const string& path)
+        : mapped(nullptr), mappedSize(0), nodes(nullptr), nodeCount(0),
+          rectCount(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            static_cast<size_t>(st.st_size) >= sizeof(SnapshotHeader)) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size),
+                             PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                mapped = p;
+                mappedSize = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+
+        if (mapped && !check()) {
+            ::munmap(mapped, mappedSize);
+            mapped = nullptr;
+            nodes = nullptr;
+        }
+    }
+
+    ~TwoDimSnapshot() {
+        if (mapped)
+            ::munmap(mapped, mappedSize);
+    }
+
+    TwoDimSnapshot(const TwoDimSnapshot&) = delete;
+    TwoDimSnapshot& operator=(const TwoDimSnapshot&) = delete;
+
+    // True if the file was mapped and looks like a snapshot of T.
+    explicit operator bool() const { return nodes != nullptr; }
+
+    /* Number of rectangles in the snapshot. */
+    size_t size() const { return rectCount; }
+
+    /*
+       write
+       Saves tree to path. Returns false if the file cannot be
+       written completely.
+
+       The image is written to a temporary file next to path, synced
+       and then renamed over it, so processes that still map an older
+       snapshot at path keep their (now unlinked) file intact.
+     */
+    static bool write(const TwoDimTree<T>& tree, const string& path) {
+        // Number the nodes in preorder
+        vector<const TwoDimTreeNode<T>*> order;
+        vector<SnapshotNode> table;
+        number(tree.root, order, table);
+
+        // Place every bucket's arrays after the node table
+        uint64_t offset = align(sizeof(SnapshotHeader) +
+                                table.size() * sizeof(SnapshotNode));
+        for (size_t i = 0; i < order.size(); ++i) {
+            for (int b = 0; b < 2; ++b) {
+                typename RectBucket<T>::View v = bucket(order[i], b).view();
+                SnapshotBucket& s = table[i].bucket[b];
+                s.key = v.key;
+                s.slots = v.slots;
+                s.indexedCount = v.indexedCount;
+                s.nodeCount = v.nodeCount;
+                s.offset = offset;
+                offset += BucketLayout(s).size;
+            }
+        }
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.itemSize = sizeof(T);
+        header.coordType = coordType();
+        header.nodeCount = table.size();
+        header.rectCount = tree.size();
+        header.fileSize = offset;
+
+        string temp = path + "." + to_string(::getpid()) + ".tmp";
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd < 0)
+            return false;
+
+        ofstream out(temp.c_str(), ios::binary | ios::trunc);
+        Writer w(out);
+        w.put(&header, sizeof(header));
+        w.put(table.data(), table.size() * sizeof(SnapshotNode));
+        w.pad();
+
+        for (size_t i = 0; i < order.size(); ++i) {
+            for (int b = 0; b < 2; ++b) {
+                typename RectBucket<T>::View v = bucket(order[i], b).view();
+                BucketLayout L(table[i].bucket[b]);
+
+                w.put(v.base.top, L.coords(v.slots));
+                w.put(v.base.left, L.coords(v.slots));
+                w.put(v.base.bottom, L.coords(v.slots));
+                w.put(v.base.right, L.coords(v.slots));
+                w.put(v.ids, L.ints(v.slots));
+                putIndex(w, v.byStart, v.indexedCount);
+                putIndex(w, v.byEnd, v.indexedCount);
+                w.put(v.nodes, v.nodeCount * sizeof(IntervalNode));
+                w.pad();
+                w.put(v.items, v.slots * sizeof(T));
+                w.pad();
+            }
+        }
+
+        out.close();
+        bool ok = static_cast<bool>(out) && w.written == header.fileSize &&
+                  ::fsync(fd) == 0;
+        ::close(fd);
+
+        if (!ok || ::rename(temp.c_str(), path.c_str()) != 0) {
+            ::unlink(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /*
+       Queries (same meaning and order as in TwoDimTree)
+
+       visit             : calls visitor(const T&) for each rectangle
+                           containing (x,y)
+       count / search    : count them / append them to result
+       visitIntersecting : calls visitor(const T&) for each rectangle
+                           overlapping W
+       searchWindow      : appends those to result
+     */
+    template <class Visitor>
+    void visit(Coord x, Coord y, Visitor&& visitor) const {
+        int32_t n = 0;
+        while (n >= 0) {
+            const SnapshotNode& node = nodes[n];
+            view(node.bucket[0]).visitContaining(x, y, visitor);
+            view(node.bucket[1]).visitContaining(x, y, visitor);
+
+            Coord centerX = node.split[0];
+            Coord centerY = node.split[1];
+            if (x == centerX || y == centerY)
+                return;
+
+            if (x < centerX && y < centerY)
+                n = node.child[0];
+            else if (x > centerX && y < centerY)
+                n = node.child[1];
+            else if (x < centerX && y > centerY)
+                n = node.child[2];
+            else
+                n = node.child[3];
+        }
+    }
+
+    size_t count(Coord x, Coord y) const {
+        size_t n = 0;
+        visit(x, y, [&n](const T&) { ++n; });
+        return n;
+    }
+
+    void search(Coord x, Coord y, vector<T>& result) const {
+        visit(x, y, [&result](const T& R) { result.push_back(R); });
+    }
+
+    template <class Visitor>
+    void visitIntersecting(const Rectangle& W, Visitor&& visitor) const {
+        if (W.Left < W.Right && W.Top < W.Bottom)
+            visitIntersecting(W, 0, visitor);
+    }
+
+    void searchWindow(const Rectangle& W, vector<T>& result) const {
+        visitIntersecting(W, [&result](const T& R) { result.push_back(R); });
+    }
+
+private:
+    typedef typename RectBucket<T>::IntervalNode IntervalNode;
+    typedef typename RectBucket<T>::BaseView BaseView;
+
+    static constexpr const char* MAGIC = "TDTSNAP";     // 8 bytes with the NUL
+    static const uint32_t VERSION = 3;     // 2: center lines per node,
+                                            // 3: coordinate types
+
+    enum { TOP, LEFT, BOTTOM, RIGHT };
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t itemSize;      // sizeof(T) of the writer
+        uint32_t coordType;     // see coordType()
+        uint32_t reserved;
+        uint64_t nodeCount;
+        uint64_t rectCount;
+        uint64_t fileSize;
+    };
+
+    struct SnapshotBucket {
+        uint32_t key;           // RectBucket<T>::SortKey
+        uint32_t reserved;
+        uint64_t slots;
+        uint64_t indexedCount;
+        uint64_t nodeCount;     // interval tree nodes
+        uint64_t offset;        // of its arrays from the start of the file
+    };
+
+    struct SnapshotNode {
+        Coord extent[4];        // Top, Left, Bottom, Right
+        int32_t child[4];       // TopLeft, TopRight, BottomLeft, BottomRight
+        Coord split[2];         // SplitX, SplitY
+        SnapshotBucket bucket[2];   // Vertical, Horizontal
+    };
+
+    /*
+       BucketLayout
+       Offsets (from the bucket's offset) of its arrays, in file order:
+       Top, Left, Bottom, Right and ids per slot; Top, Left, Bottom,
+       Right and index of byStart, the same for byEnd; the interval
+       nodes; the items.
+     */
+    struct BucketLayout {
+        uint64_t base[5];
+        uint64_t byStart[5];
+        uint64_t byEnd[5];
+        uint64_t nodes;
+        uint64_t items;
+        uint64_t size;
+
+        explicit BucketLayout(const SnapshotBucket& b) {
+            uint64_t at = 0;
+            arrays(at, b.slots, base);
+            arrays(at, b.indexedCount, byStart);
+            arrays(at, b.indexedCount, byEnd);
+            nodes = take(at, b.nodeCount * sizeof(IntervalNode));
+            items = take(at, b.slots * sizeof(T));
+            size = at;
+        }
+
+        // Bytes of an array of n 32-bit values.
+        static uint64_t ints(uint64_t n) { return n * 4; }
+
+        // Bytes of an array of n coordinates.
+        static uint64_t coords(uint64_t n) { return n * sizeof(Coord); }
+
+        // Four coordinate arrays and one of 32-bit values, n each.
+        static void arrays(uint64_t& at, uint64_t n, uint64_t* offsets) {
+            for (int i = 0; i < 4; ++i)
+                offsets[i] = take(at, coords(n));
+            offsets[4] = take(at, ints(n));
+        }
+
+        static uint64_t take(uint64_t& at, uint64_t bytes) {
+            uint64_t start = at;
+            at = align(at + bytes);
+            return start;
+        }
+    };
+
+    /* Sequential output that keeps every array 8-byte aligned. */
+    struct Writer {
+        ofstream& out;
+        uint64_t written;
+
+        explicit Writer(ofstream& o) : out(o), written(0) {}
+
+        // Writes bytes, then pads to the next 8-byte boundary.
+        void put(const void* data, uint64_t bytes) {
+            if (bytes > 0)
+                out.write(static_cast<const char*>(data), bytes);
+            written += bytes;
+            pad();
+        }
+
+        void pad() {
+            static const char zeros[8] = { 0 };
+            uint64_t to = align(written);
+            out.write(zeros, to - written);
+            written = to;
+        }
+    };
+
+    void* mapped;
+    size_t mappedSize;
+    const SnapshotNode* nodes;
+    size_t nodeCount;
+    size_t rectCount;
+
+    static uint64_t align(uint64_t at) { return (at + 7) & ~uint64_t(7); }
+
+    static const RectBucket<T>& bucket(const TwoDimTreeNode<T>* node, int b) {
+        return b == 0 ? node->Vertical : node->Horizontal;
+    }
+
+    /* Appends node and its subtree to order/table; returns its index. */
+    static int32_t number(const TwoDimTreeNode<T>* node,
+                          vector<const TwoDimTreeNode<T>*>& order,
+                          vector<SnapshotNode>& table) {
+        if (!node)
+            return -1;
+
+        int32_t self = static_cast<int32_t>(order.size());
+        order.push_back(node);
+
+        SnapshotNode s;
+        memset(&s, 0, sizeof(s));
+        s.extent[TOP] = node->Extent.Top;
+        s.extent[LEFT] = node->Extent.Left;
+        s.extent[BOTTOM] = node->Extent.Bottom;
+        s.extent[RIGHT] = node->Extent.Right;
+        s.split[0] = node->SplitX;
+        s.split[1] = node->SplitY;
+        table.push_back(s);
+
+        int32_t children[4] = {
+            number(node->TopLeft, order, table),
+            number(node->TopRight, order, table),
+            number(node->BottomLeft, order, table),
+            number(node->BottomRight, order, table)
+        };
+        memcpy(table[self].child, children, sizeof(children));
+        return self;
+    }
+
+    static void putIndex(Writer& w, const BaseView& v, uint64_t n) {
+        w.put(v.top, BucketLayout::coords(n));
+        w.put(v.left, BucketLayout::coords(n));
+        w.put(v.bottom, BucketLayout::coords(n));
+        w.put(v.right, BucketLayout::coords(n));
+        w.put(v.index, BucketLayout::ints(n));
+    }
+
+    /* The coordinate type in a word: its size, whether it is a
+       floating-point type and whether it is signed. */
+    static uint32_t coordType() {
+        return static_cast<uint32_t>(sizeof(Coord)) |
+               (is_floating_point<Coord>::value ? 0x100u : 0u) |
+               (is_signed<Coord>::value ? 0x200u : 0u);
+    }
+
+    /* Validates the header, the node table, the bucket bounds and
+       every bucket's interval index (see checkIndex), so that no
+       query reads outside the file however it was damaged. */
+    bool check() {
+        const char* base = static_cast<const char*>(mapped);
+        SnapshotHeader header;
+        memcpy(&header, base, sizeof(header));
+
+        if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != VERSION || header.itemSize != sizeof(T) ||
+            header.coordType != coordType() ||
+            header.fileSize != mappedSize || header.nodeCount == 0 ||
+            header.nodeCount > (mappedSize - sizeof(header)) / sizeof(SnapshotNode))
+            return false;
+
+        const SnapshotNode* table =
+            reinterpret_cast<const SnapshotNode*>(base + sizeof(header));
+        for (uint64_t i = 0; i < header.nodeCount; ++i) {
+            // Children come after their parent: no cycles
+            for (int c = 0; c < 4; ++c) {
+                int32_t child = table[i].child[c];
+                if (child != -1 && (child <= static_cast<int64_t>(i) ||
+                                    static_cast<uint64_t>(child) >= header.nodeCount))
+                    return false;
+            }
+            for (int b = 0; b < 2; ++b) {
+                const SnapshotBucket& s = table[i].bucket[b];
+                if (s.key > RectBucket<T>::BY_LEFT || s.offset % 8 != 0 ||
+                    s.indexedCount > s.slots || s.slots > mappedSize ||
+                    s.nodeCount > mappedSize || s.offset > mappedSize ||
+                    BucketLayout(s).size > mappedSize - s.offset ||
+                    !checkIndex(s))
+                    return false;
+            }
+        }
+
+        nodes = table;
+        nodeCount = header.nodeCount;
+        rectCount = header.rectCount;
+        return true;
+    }
+
+    /* Interval nodes of a bucket: ranges within the indexed
+       positions, children after their parent (no cycles); index
+       entries within the slots. */
+    bool checkIndex(const SnapshotBucket& s) const {
+        typename RectBucket<T>::View v = view(s);
+        for (uint64_t n = 0; n < s.nodeCount; ++n) {
+            const IntervalNode& node = v.nodes[n];
+            unsigned char leaf;
+            memcpy(&leaf, &node.leaf, 1);
+            if (leaf > 1 ||
+                uint64_t(node.begin) + node.count > s.indexedCount)
+                return false;
+            for (int32_t child : { node.lower, node.upper }) {
+                if (child != -1 && (child <= static_cast<int64_t>(n) ||
+                                    static_cast<uint64_t>(child) >= s.nodeCount))
+                    return false;
+            }
+        }
+        for (uint64_t i = 0; i < s.indexedCount; ++i) {
+            if (v.byStart.index[i] >= s.slots || v.byEnd.index[i] >= s.slots)
+                return false;
+        }
+        return true;
+    }
+
+    /* The query view of a bucket in the mapped file. */
+    typename RectBucket<T>::View view(const SnapshotBucket& s) const {
+        const char* at = static_cast<const char*>(mapped) + s.offset;
+        BucketLayout L(s);
+
+        typename RectBucket<T>::View v;
+        v.key = static_cast<typename RectBucket<T>::SortKey>(s.key);
+        v.slots = s.slots;
+        v.indexedCount = s.indexedCount;
+        v.base = coords(at, L.base, false);
+        v.byStart = coords(at, L.byStart, true);
+        v.byEnd = coords(at, L.byEnd, true);
+        v.items = reinterpret_cast<const T*>(at + L.items);
+        v.ids = reinterpret_cast<const uint32_t*>(at + L.base[4]);
+        v.nodes = reinterpret_cast<const IntervalNode*>(at + L.nodes);
+        v.nodeCount = s.nodeCount;
+        return v;
+    }
+
+    static BaseView coords(const char* at, const uint64_t* offsets,
+                           bool indexed) {
+        BaseView v = {
+            reinterpret_cast<const Coord*>(at + offsets[TOP]),
+            reinterpret_cast<const Coord*>(at + offsets[LEFT]),
+            reinterpret_cast<const Coord*>(at + offsets[BOTTOM]),
+            reinterpret_cast<const Coord*>(at + offsets[RIGHT]),
+            indexed ? reinterpret_cast<const uint32_t*>(at + offsets[4])
+                    : nullptr
+        };
+        return v;
+    }
+
+    template <class Visitor>
+    void visitIntersecting(const Rectangle& W, int32_t n,
+                           Visitor& visitor) const {
+        if (n < 0) return;
+
+        const SnapshotNode& node = nodes[n];
+        if (node.extent[LEFT] >= W.Right || W.Left >= node.extent[RIGHT] ||
+            node.extent[TOP] >= W.Bottom || W.Top >= node.extent[BOTTOM])
+            return;
+
+        view(node.bucket[0]).visitIntersecting(W, visitor);
+        view(node.bucket[1]).visitIntersecting(W, visitor);
+        for (int c = 0; c < 4; ++c)
+            visitIntersecting(W, node.child[c], visitor);
+    }
+};
+
+#endif
@@ -2,24 +2,47 @@
 #define TWODIMTREE_H
 
 #include <iostream>
+#include <algorithm>
+#include <climits>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory_resource>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../common/ThreadPool.h"
+#include "Arena.h"
+#include "ContainsKernel.h"
 using namespace std;
 
 
-class Rectangle {
+/* 
+   BasicRectangle
+   A rectangle with coordinates of type Coord (any arithmetic type;
+   see CoordTraits). Rectangle, with int coordinates, is the one
+   the programs here use.
+ */
+template <class Coord>
+class BasicRectangle {
 public:
-    int Top;      // y-coordinate of upper edge
-    int Left;     // x-coordinate of left edge
-    int Bottom;   // y-coordinate of lower edge (exclusive)
-    int Right;    // x-coordinate of right edge (exclusive)
+    Coord Top;      // y-coordinate of upper edge
+    Coord Left;     // x-coordinate of left edge
+    Coord Bottom;   // y-coordinate of lower edge (exclusive)
+    Coord Right;    // x-coordinate of right edge (exclusive)
 
-    Rectangle() : Top(0), Left(0), Bottom(0), Right(0) {}
+    BasicRectangle() : Top(0), Left(0), Bottom(0), Right(0) {}
 
-    Rectangle(int t, int l, int b, int r)
+    BasicRectangle(Coord t, Coord l, Coord b, Coord r)
         : Top(t), Left(l), Bottom(b), Right(r) {}
 
     // Returns true if point (x,y) lies inside the rectangle.
     // Right and Bottom edges are EXCLUDED, as required.
-    bool contains(int x, int y) const {
+    bool contains(Coord x, Coord y) const {
         return (Left <= x && x < Right &&
                 Top  <= y && y < Bottom);
     }
@@ -31,6 +54,94 @@ public:
     }
 };
 
+typedef BasicRectangle<int> Rectangle;
+
+/* 
+   RectEntry
+   A rectangle with a payload of the user's stored right next to
+   its edges, e.g. TwoDimTree<RectEntry<float, ShopId>>. Any other
+   type with the four edges will do as well (see RectTraits).
+ */
+template <class Coord, class Payload>
+class RectEntry : public BasicRectangle<Coord> {
+public:
+    Payload Data;
+
+    RectEntry() : Data() {}
+
+    RectEntry(const BasicRectangle<Coord>& r, const Payload& d)
+        : BasicRectangle<Coord>(r), Data(d) {}
+};
+
+/* 
+   CoordTraits
+   What the tree needs to know about a coordinate type.
+   Integer coordinates number cells: [Left, Right) covers cells
+   Left .. Right - 1, neighbouring cells are CELL apart and a point
+   is a cell. Floating-point coordinates are continuous (CELL 0).
+ */
+template <class Coord>
+struct CoordTraits {
+    static_assert(is_arithmetic<Coord>::value,
+                  "coordinates must be of an arithmetic type");
+
+    static constexpr Coord CELL = is_integral<Coord>::value ? 1 : 0;
+
+    static Coord mid(Coord a, Coord b) { return static_cast<Coord>((a + b) / 2); }
+
+    // Below every coordinate: [LOWEST, LOWEST) meets no point.
+    static Coord lowest() { return numeric_limits<Coord>::lowest(); }
+};
+
+/* 
+   RectTraits
+   The stored type T must have public members Top, Left, Bottom and
+   Right, all of one arithmetic type: its Coord. Anything else in T
+   is payload, stored and handed back untouched. The checks are
+   static_asserts, so a wrong T fails with one of their messages.
+ */
+template <class T, class = void>
+struct HasEdges : false_type {};
+
+template <class T>
+struct HasEdges<T, void_t<decltype(declval<const T&>().Top),
+                          decltype(declval<const T&>().Left),
+                          decltype(declval<const T&>().Bottom),
+                          decltype(declval<const T&>().Right)> >
+    : true_type {};
+
+template <class T, bool = HasEdges<T>::value>
+struct EdgeTypes {
+    typedef int Top;    // placeholder, T was rejected already
+    typedef int Left;
+    typedef int Bottom;
+    typedef int Right;
+};
+
+template <class T>
+struct EdgeTypes<T, true> {
+    typedef typename decay<decltype(declval<const T&>().Top)>::type Top;
+    typedef typename decay<decltype(declval<const T&>().Left)>::type Left;
+    typedef typename decay<decltype(declval<const T&>().Bottom)>::type Bottom;
+    typedef typename decay<decltype(declval<const T&>().Right)>::type Right;
+};
+
+template <class T>
+struct RectTraits {
+    static_assert(HasEdges<T>::value,
+                  "T needs public members Top, Left, Bottom and Right");
+
+    typedef EdgeTypes<T> Edges;
+    typedef typename Edges::Top Coord;
+
+    static_assert(is_same<Coord, typename Edges::Left>::value &&
+                  is_same<Coord, typename Edges::Bottom>::value &&
+                  is_same<Coord, typename Edges::Right>::value,
+                  "Top, Left, Bottom and Right must have the same type");
+    static_assert(is_arithmetic<Coord>::value,
+                  "coordinates must be of an arithmetic type");
+};
+
 
 class BadIterator {};
 
@@ -84,17 +195,17 @@ private:
 
 /* --------------------------- List ---------------------------
    A singly linked list with support for:
-   - inserting at end,
+   - inserting at end (constant time, through a tail pointer),
    - obtaining an iterator to the first node,
    - counting elements.
    ----------------------------------------------------------- */
 template <class Object>
 class List {
 public:
-    List() { header = new ListNode<Object>; }
+    List() { header = tail = new ListNode<Object>; }
 
     List(const List & rhs) {
-        header = new ListNode<Object>;
+        header = tail = new ListNode<Object>;
         *this = rhs;
     }
 
@@ -107,16 +218,17 @@ public:
 
     // Insert new node after the iterator position.
     void insert(const Object & x, const ListItr<Object> & p) {
-        if (p.current != nullptr)
+        if (p.current != nullptr) {
             p.current->next = new ListNode<Object>(x, p.current->next);
+            if (p.current == tail)
+                tail = p.current->next;
+        }
     }
 
     // Insert at end of list.
     void insertAtEnd(const Object& x) {
-        ListNode<Object>* itr = header;
-        while (itr->next != nullptr)
-            itr = itr->next;
-        itr->next = new ListNode<Object>(x, nullptr);
+        tail->next = new ListNode<Object>(x, nullptr);
+        tail = tail->next;
     }
 
     // Return iterator to first real element.
@@ -137,6 +249,7 @@ public:
 
 private:
     ListNode<Object>* header;
+    ListNode<Object>* tail;     // last node (header if empty)
 
     // Delete all nodes after the header.
     void makeEmpty() {
@@ -145,6 +258,658 @@ private:
             header->next = old->next;
             delete old;
         }
+        tail = header;
+    }
+};
+
+template <class T> class TwoDimSnapshot;
+template <class T> class ConcurrentTwoDimTree;
+
+/* 
+   squaredDistance
+   Squared Euclidean distance from point (x,y) to the cells covered
+   by rectangle [left, right) x [top, bottom) (to the area, for
+   floating-point coordinates); 0 exactly when the rectangle
+   contains the point.
+ */
+template <class Coord>
+inline double squaredDistance(Coord x, Coord y, Coord top, Coord left,
+                              Coord bottom, Coord right) {
+    const double cell = CoordTraits<Coord>::CELL;
+    double dx = x < left ? double(left) - x
+              : x >= right ? double(x) - right + cell : 0.0;
+    double dy = y < top ? double(top) - y
+              : y >= bottom ? double(y) - bottom + cell : 0.0;
+    return dx * dx + dy * dy;
+}
+
+/* ------------------------ RectBucket -------------------------
+   The rectangles of one node, stored as structure-of-arrays:
+   one contiguous array per coordinate (Top[], Left[], Bottom[],
+   Right[]) plus the stored objects themselves. Containment scans
+   stream through coordinate arrays (ContainsKernel.h) and only
+   touch an object when it is a hit.
+
+   Interval index:
+   Every rectangle of a Vertical bucket crosses the node's vertical
+   center line, so for a query point the x test is one-sided and
+   the y interval [Top, Bottom) decides most of it. Such a bucket is
+   indexed on y (BY_TOP); a Horizontal bucket on x (BY_LEFT).
+
+   The index is a centered interval tree over those intervals. Each
+   tree node holds the intervals that contain its center twice: once
+   sorted by start ascending, once by end descending. A query q left
+   of the center only needs the start-sorted prefix with start <= q,
+   right of it the end-sorted prefix with end > q; both prefixes are
+   found by binary search and hold only intervals that contain q.
+   So a bucket of m rectangles costs O(log m + k) interval tests,
+   k being the rectangles whose interval contains q. Hits are then
+   sorted back into insertion order (O(h log h) for h hits), so the
+   index never changes the order in which a query reports them.
+
+   Buckets of at most LEAF_SIZE rectangles, and subtrees that small,
+   are not searched but scanned: the SIMD kernel is faster there.
+
+   New rectangles go to an unsorted tail that is scanned in full;
+   add() rebuilds the index once the tail reaches an eighth of the
+   bucket (at least MIN_TAIL rectangles), which keeps insertion
+   amortized O(log m). compact() rebuilds it right away.
+
+   Slots and removal:
+   Every rectangle keeps its slot (position in insertion order) and
+   the id the tree gave it. remove() leaves a dead slot behind: its
+   free-axis interval is moved to the empty [lowest, lowest), which
+   no point or window meets, while the indexed axis and so the sort
+   order of the index stay intact. Once half the slots are dead the
+   bucket is packed and re-indexed; the slots that move are reported.
+   ----------------------------------------------------------- */
+template <class T>
+class RectBucket {
+public:
+    typedef typename RectTraits<T>::Coord Coord;
+
+    enum SortKey { BY_TOP, BY_LEFT };
+
+    /* All arrays, the index included, allocate from memory
+       (the tree's Arena; the default heap otherwise). */
+    explicit RectBucket(SortKey k = BY_TOP,
+                        pmr::memory_resource* memory = pmr::get_default_resource())
+        : key(k), indexedCount(0), dead(0),
+          Top(memory), Left(memory), Bottom(memory), Right(memory),
+          items(memory), ids(memory),
+          nodes(memory), byStart(memory), byEnd(memory) {}
+
+    bool isEmpty() const { return size() == 0; }
+
+    // Live rectangles (dead slots not counted).
+    size_t size() const { return items.size() - dead; }
+
+    // Slots in use, dead ones included.
+    size_t slots() const { return items.size(); }
+
+    const T& item(size_t slot) const { return items[slot]; }
+
+    // Id stored with the rectangle in slot (DEAD once removed).
+    uint32_t id(size_t slot) const { return ids[slot]; }
+
+    static const uint32_t DEAD = UINT32_MAX;
+
+    // Append a rectangle; returns its slot.
+    uint32_t add(const T& R, uint32_t id) {
+        uint32_t slot = static_cast<uint32_t>(items.size());
+        Top.push_back(R.Top);
+        Left.push_back(R.Left);
+        Bottom.push_back(R.Bottom);
+        Right.push_back(R.Right);
+        items.push_back(R);
+        ids.push_back(id);
+
+        size_t tail = items.size() - indexedCount;
+        if (tail >= MIN_TAIL && tail * 8 >= indexedCount)
+            compact();
+        return slot;
+    }
+
+    // Append n rectangles with ids Ids[0 .. n) and index them once;
+    // they take the next n slots.
+    void addAll(const T* R, const uint32_t* Ids, size_t n) {
+        if (n == 0)
+            return;
+
+        Top.reserve(Top.size() + n);
+        Left.reserve(Left.size() + n);
+        Bottom.reserve(Bottom.size() + n);
+        Right.reserve(Right.size() + n);
+        items.reserve(items.size() + n);
+        ids.reserve(ids.size() + n);
+        for (size_t i = 0; i < n; ++i) {
+            Top.push_back(R[i].Top);
+            Left.push_back(R[i].Left);
+            Bottom.push_back(R[i].Bottom);
+            Right.push_back(R[i].Right);
+            items.push_back(R[i]);
+            ids.push_back(Ids[i]);
+        }
+        compact();
+    }
+
+    /*
+       Removes the rectangle in slot, in O(m) at worst (finding its
+       copies in the index). If that triggers packing, moved(id, slot)
+       is called for every rectangle that changes slot.
+     */
+    template <class Moved>
+    void remove(uint32_t slot, Moved& moved) {
+        ids[slot] = DEAD;
+        ++dead;
+
+        kill(Top, Left, Bottom, Right, slot);
+        if (slot < indexedCount) {
+            kill(byStart, slot);
+            kill(byEnd, slot);
+        }
+
+        if (dead * 2 >= items.size())
+            pack(moved);
+    }
+
+    // Drops every rectangle and the index (keeps the memory).
+    void clear() {
+        Top.clear(); Left.clear(); Bottom.clear(); Right.clear();
+        items.clear();
+        ids.clear();
+        nodes.clear();
+        byStart.clear();
+        byEnd.clear();
+        indexedCount = 0;
+        dead = 0;
+    }
+
+    // Rebuild the interval index over all rectangles
+    // (small buckets are only ever scanned, so they get none).
+    void compact() {
+        size_t n = items.size();
+        if (indexedCount == n || n <= LEAF_SIZE)
+            return;
+
+        nodes.clear();
+        byStart.clear();
+        byEnd.clear();
+
+        vector<uint32_t> all(n);
+        for (size_t i = 0; i < n; ++i)
+            all[i] = static_cast<uint32_t>(i);
+        build(all);
+
+        indexedCount = n;
+    }
+
+private:
+    /*
+       IntervalNode
+       Intervals containing center occupy positions
+       [begin, begin + count) of both byStart and byEnd.
+       lower/upper: children with intervals entirely before or
+       after center (-1 if none).
+       Subtrees of at most LEAF_SIZE intervals become one leaf.
+     */
+    struct IntervalNode {
+        bool leaf;              // no center: test all of [begin, begin + count)
+        Coord center;
+        uint32_t begin;
+        uint32_t count;
+        int32_t lower;
+        int32_t upper;
+    };
+
+    /* Slots of the indexed hits of one query, kept on the stack
+       unless there are more than LOCAL of them. */
+    struct SlotBuffer {
+        static const size_t LOCAL = 64;
+        uint32_t local[LOCAL];
+        vector<uint32_t> spill;
+        size_t n = 0;
+
+        void push(uint32_t slot) {
+            if (n < LOCAL) {
+                local[n] = slot;
+            } else {
+                if (n == LOCAL)
+                    spill.assign(local, local + LOCAL);
+                spill.push_back(slot);
+            }
+            ++n;
+        }
+
+        uint32_t* begin() { return n <= LOCAL ? local : spill.data(); }
+        uint32_t* end() { return begin() + n; }
+    };
+
+    // One ordering of the coordinate arrays as plain pointers.
+    struct BaseView {
+        const Coord* top;
+        const Coord* left;
+        const Coord* bottom;
+        const Coord* right;
+        const uint32_t* index;      // nullptr: position is the index
+    };
+
+public:
+    /*
+       View
+       The query side of a bucket: plain pointers into its arrays, so
+       the same code answers queries on a live bucket and on one read
+       from a snapshot (TwoDimSnapshot.h).
+     */
+    struct View {
+        SortKey key;
+        size_t slots;                   // entries of base, items and ids
+        size_t indexedCount;
+        BaseView base;                  // insertion order, no index
+        BaseView byStart;               // interval index, two orders
+        BaseView byEnd;
+        const T* items;
+        const uint32_t* ids;
+        const IntervalNode* nodes;
+        size_t nodeCount;
+
+        const Coord* starts() const { return key == BY_TOP ? byStart.top : byStart.left; }
+        const Coord* ends() const { return key == BY_TOP ? byEnd.bottom : byEnd.right; }
+
+        // Calls visitor(R) for every stored R containing point (x,y)
+        // (Right and Bottom edges excluded), in insertion order: the
+        // index finds its hits in its own order, so they are sorted
+        // by slot before the tail is scanned.
+        template <class Visitor>
+        void visitContaining(Coord x, Coord y, Visitor& visitor) const {
+            SlotBuffer hits;
+            auto found = [&hits](uint32_t slot) { hits.push(slot); };
+            findIndexed(x, y, found);
+            sort(hits.begin(), hits.end());
+            for (uint32_t* h = hits.begin(); h != hits.end(); ++h)
+                visitor(items[*h]);
+
+            auto visit = [this, &visitor](uint32_t slot) { visitor(items[slot]); };
+            scanRange(base, indexedCount, slots, x, y, visit);
+        }
+
+        // Calls found(slot) for every indexed rectangle containing
+        // (x,y), in the order of the interval index.
+        template <class Found>
+        void findIndexed(Coord x, Coord y, Found& found) const {
+            // q: coordinate along the indexed axis
+            Coord q = key == BY_TOP ? y : x;
+
+            int32_t n = nodeCount == 0 ? -1 : 0;
+            while (n >= 0) {
+                const IntervalNode& node = nodes[n];
+
+                if (node.leaf) {
+                    // Few intervals: test them all
+                    scanRange(byStart, node.begin, node.begin + node.count,
+                              x, y, found);
+                    n = -1;
+                } else if (q < node.center) {
+                    // Start-sorted prefix: start <= q < center < end
+                    const Coord* start = starts() + node.begin;
+                    size_t count = upper_bound(start, start + node.count, q) -
+                                   start;
+                    scanRange(byStart, node.begin, node.begin + count,
+                              x, y, found);
+                    n = node.lower;
+                } else {
+                    // End-sorted prefix: start <= center <= q < end
+                    const Coord* end = ends() + node.begin;
+                    size_t count = partition_point(end, end + node.count,
+                                                   [q](Coord e) { return e > q; }) -
+                                   end;
+                    scanRange(byEnd, node.begin, node.begin + count,
+                              x, y, found);
+                    n = q > node.center ? node.upper : -1;
+                }
+            }
+        }
+
+        // Calls visitor(R) for every stored R that overlaps window W
+        // (all edges half-open, like contains).
+        template <class Visitor>
+        void visitIntersecting(const BasicRectangle<Coord>& W,
+                               Visitor& visitor) const {
+            // [q0, q1): the window along the indexed axis
+            Coord q0 = key == BY_TOP ? W.Top : W.Left;
+            Coord q1 = key == BY_TOP ? W.Bottom : W.Right;
+            if (q1 <= q0 || slots == 0)
+                return;
+
+            if (nodeCount > 0)
+                visitOverlap(0, q0, q1, W, visitor);
+            intersectRange(base, indexedCount, slots, W, visitor);
+        }
+
+        // Calls visitor(R, d) for every stored R whose squared distance d
+        // to (x,y) is below bound; the visitor may lower bound as it goes.
+        template <class Visitor>
+        void visitNear(Coord x, Coord y, const double& bound,
+                       Visitor& visitor) const {
+            for (size_t i = 0; i < slots; ++i) {
+                if (ids[i] == DEAD)
+                    continue;
+                double d = squaredDistance(x, y, base.top[i], base.left[i],
+                                           base.bottom[i], base.right[i]);
+                if (d < bound)
+                    visitor(items[i], d);
+            }
+        }
+
+        /*
+           Interval tree walk for a window [q0, q1) along the indexed axis.
+           Every interval of a node contains its center c, so:
+           window before c -> those starting before q1, then the lower side;
+           window after c  -> those ending after q0, then the upper side;
+           window over c   -> all of them, then both sides.
+         */
+        template <class Visitor>
+        void visitOverlap(int32_t n, Coord q0, Coord q1,
+                          const BasicRectangle<Coord>& W,
+                          Visitor& visitor) const {
+            while (n >= 0) {
+                const IntervalNode& node = nodes[n];
+
+                if (node.leaf) {
+                    intersectRange(byStart, node.begin,
+                                   node.begin + node.count, W, visitor);
+                    return;
+                }
+
+                if (q1 <= node.center) {
+                    const Coord* start = starts() + node.begin;
+                    size_t count = lower_bound(start, start + node.count, q1) -
+                                   start;
+                    intersectRange(byStart, node.begin, node.begin + count,
+                                   W, visitor);
+                    n = node.lower;
+                } else if (q0 > node.center) {
+                    const Coord* end = ends() + node.begin;
+                    size_t count = partition_point(end, end + node.count,
+                                                   [q0](Coord e) { return e > q0; }) -
+                                   end;
+                    intersectRange(byEnd, node.begin, node.begin + count,
+                                   W, visitor);
+                    n = node.upper;
+                } else {
+                    intersectRange(byStart, node.begin,
+                                   node.begin + node.count, W, visitor);
+                    if (node.lower >= 0)
+                        visitOverlap(node.lower, q0, q1, W, visitor);
+                    n = node.upper;
+                }
+            }
+        }
+
+        // Visits the rectangles at positions [from, to) that overlap W.
+        template <class Visitor>
+        void intersectRange(const BaseView& v, size_t from, size_t to,
+                            const BasicRectangle<Coord>& W,
+                            Visitor& visitor) const {
+            for (size_t i = from; i < to; ++i) {
+                if (v.left[i] < W.Right && W.Left < v.right[i] &&
+                    v.top[i] < W.Bottom && W.Top < v.bottom[i])
+                    visitor(items[v.index ? v.index[i] : i]);
+            }
+        }
+
+        // Tests positions [from, to) with the SIMD kernel and calls
+        // found(slot) for the hits in order, at most CHUNK rectangles
+        // per kernel call.
+        template <class Found>
+        void scanRange(const BaseView& v, size_t from, size_t to,
+                       Coord x, Coord y, Found& found) const {
+            const size_t CHUNK = 512;
+            uint64_t masks[CHUNK / 64];
+
+            for (size_t base = from; base < to; base += CHUNK) {
+                size_t m = to - base < CHUNK ? to - base : CHUNK;
+                ContainsKernel::containsMask(v.top + base, v.left + base,
+                                             v.bottom + base, v.right + base,
+                                             m, x, y, masks);
+
+                for (size_t w = 0; w < (m + 63) / 64; ++w) {
+                    for (uint64_t bits = masks[w]; bits; bits &= bits - 1) {
+                        size_t i = base + w * 64 + ContainsKernel::lowestBit(bits);
+                        found(v.index ? v.index[i] : static_cast<uint32_t>(i));
+                    }
+                }
+            }
+        }
+    };
+
+    View view() const {
+        View v;
+        v.key = key;
+        v.slots = items.size();
+        v.indexedCount = indexedCount;
+        v.base = coords(Top, Left, Bottom, Right, nullptr);
+        v.byStart = coords(byStart.Top, byStart.Left, byStart.Bottom,
+                           byStart.Right, byStart.index.data());
+        v.byEnd = coords(byEnd.Top, byEnd.Left, byEnd.Bottom, byEnd.Right,
+                         byEnd.index.data());
+        v.items = items.data();
+        v.ids = ids.data();
+        v.nodes = nodes.data();
+        v.nodeCount = nodes.size();
+        return v;
+    }
+
+    // Queries, see View
+    template <class Visitor>
+    void visitContaining(Coord x, Coord y, Visitor& visitor) const {
+        view().visitContaining(x, y, visitor);
+    }
+
+    template <class Visitor>
+    void visitIntersecting(const BasicRectangle<Coord>& W,
+                           Visitor& visitor) const {
+        view().visitIntersecting(W, visitor);
+    }
+
+    template <class Visitor>
+    void visitNear(Coord x, Coord y, const double& bound,
+                   Visitor& visitor) const {
+        view().visitNear(x, y, bound, visitor);
+    }
+
+private:
+    friend class TwoDimSnapshot<T>;
+
+    static const size_t MIN_TAIL = 64;
+    static const size_t LEAF_SIZE = 256;
+
+    /*
+       Coords
+       Coordinate arrays of one ordering plus, for each position,
+       the index of the rectangle in items.
+     */
+    struct Coords {
+        pmr::vector<Coord> Top;
+        pmr::vector<Coord> Left;
+        pmr::vector<Coord> Bottom;
+        pmr::vector<Coord> Right;
+        pmr::vector<uint32_t> index;
+
+        explicit Coords(pmr::memory_resource* memory)
+            : Top(memory), Left(memory), Bottom(memory), Right(memory),
+              index(memory) {}
+
+        void clear() {
+            Top.clear(); Left.clear(); Bottom.clear(); Right.clear();
+            index.clear();
+        }
+    };
+
+    SortKey key;
+    size_t indexedCount;                // items [0, indexedCount) are indexed
+    size_t dead;                        // removed slots not yet packed
+
+    // Insertion order (the tail is scanned here), one entry per slot
+    pmr::vector<Coord> Top;
+    pmr::vector<Coord> Left;
+    pmr::vector<Coord> Bottom;
+    pmr::vector<Coord> Right;
+    pmr::vector<T> items;
+    pmr::vector<uint32_t> ids;
+
+    // Interval index
+    pmr::vector<IntervalNode> nodes;    // nodes[0] is the root
+    Coords byStart;
+    Coords byEnd;
+
+    Coord startOf(uint32_t i) const { return key == BY_TOP ? Top[i] : Left[i]; }
+    Coord endOf(uint32_t i) const { return key == BY_TOP ? Bottom[i] : Right[i]; }
+
+    // Builds the subtree for rectangles ids; returns its node index.
+    int32_t build(vector<uint32_t>& ids) {
+        if (ids.empty())
+            return -1;
+
+        // A short list is scanned faster by the SIMD kernel than searched
+        if (ids.size() <= LEAF_SIZE) {
+            IntervalNode node;
+            node.leaf = true;
+            node.center = Coord();
+            node.begin = static_cast<uint32_t>(byStart.index.size());
+            node.count = static_cast<uint32_t>(ids.size());
+            node.lower = node.upper = -1;
+            nodes.push_back(node);
+            append(byStart, ids);
+            append(byEnd, ids);
+            return static_cast<int32_t>(nodes.size() - 1);
+        }
+
+        /*
+           The center is the median start of the non-empty intervals,
+           so it lies inside at least one of them and each side gets
+           at most half. Empty intervals (end <= start) contain no
+           point; they stay in this node, where the tests reject them.
+         */
+        vector<Coord> starts;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (endOf(ids[i]) > startOf(ids[i]))
+                starts.push_back(startOf(ids[i]));
+        }
+
+        Coord center = Coord();
+        if (!starts.empty()) {
+            nth_element(starts.begin(), starts.begin() + starts.size() / 2,
+                        starts.end());
+            center = starts[starts.size() / 2];
+        }
+
+        vector<uint32_t> here, lowerIds, upperIds;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            uint32_t id = ids[i];
+            if (starts.empty() || endOf(id) <= startOf(id))
+                here.push_back(id);
+            else if (endOf(id) <= center)
+                lowerIds.push_back(id);
+            else if (startOf(id) > center)
+                upperIds.push_back(id);
+            else
+                here.push_back(id);
+        }
+        vector<uint32_t>().swap(ids);
+
+        int32_t self = static_cast<int32_t>(nodes.size());
+        IntervalNode node;
+        node.leaf = false;
+        node.center = center;
+        node.begin = static_cast<uint32_t>(byStart.index.size());
+        node.count = static_cast<uint32_t>(here.size());
+        nodes.push_back(node);
+
+        stable_sort(here.begin(), here.end(), [this](uint32_t a, uint32_t b) {
+            return startOf(a) < startOf(b);
+        });
+        append(byStart, here);
+
+        stable_sort(here.begin(), here.end(), [this](uint32_t a, uint32_t b) {
+            return endOf(a) > endOf(b);
+        });
+        append(byEnd, here);
+
+        int32_t lower = build(lowerIds);
+        int32_t upper = build(upperIds);
+        nodes[self].lower = lower;
+        nodes[self].upper = upper;
+        return self;
+    }
+
+    // Empties the free-axis interval of position i (see class comment).
+    void kill(pmr::vector<Coord>& top, pmr::vector<Coord>& left,
+              pmr::vector<Coord>& bottom, pmr::vector<Coord>& right, size_t i) {
+        if (key == BY_TOP)
+            left[i] = right[i] = CoordTraits<Coord>::lowest();
+        else
+            top[i] = bottom[i] = CoordTraits<Coord>::lowest();
+    }
+
+    void kill(Coords& c, uint32_t slot) {
+        size_t i = find(c.index.begin(), c.index.end(), slot) - c.index.begin();
+        kill(c.Top, c.Left, c.Bottom, c.Right, i);
+    }
+
+    // Squeezes out the dead slots (order kept) and rebuilds the index.
+    template <class Moved>
+    void pack(Moved& moved) {
+        size_t live = 0;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (ids[i] == DEAD)
+                continue;
+            if (live != i) {
+                Top[live] = Top[i];
+                Left[live] = Left[i];
+                Bottom[live] = Bottom[i];
+                Right[live] = Right[i];
+                items[live] = std::move(items[i]);
+                ids[live] = ids[i];
+                moved(ids[live], static_cast<uint32_t>(live));
+            }
+            ++live;
+        }
+
+        Top.resize(live);
+        Left.resize(live);
+        Bottom.resize(live);
+        Right.resize(live);
+        items.erase(items.begin() + live, items.end());
+        ids.resize(live);
+        dead = 0;
+
+        nodes.clear();
+        byStart.clear();
+        byEnd.clear();
+        indexedCount = 0;
+        compact();
+    }
+
+    void append(Coords& c, const vector<uint32_t>& ids) {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            c.Top.push_back(Top[ids[i]]);
+            c.Left.push_back(Left[ids[i]]);
+            c.Bottom.push_back(Bottom[ids[i]]);
+            c.Right.push_back(Right[ids[i]]);
+            c.index.push_back(ids[i]);
+        }
+    }
+
+
+    static BaseView coords(const pmr::vector<Coord>& top,
+                           const pmr::vector<Coord>& left,
+                           const pmr::vector<Coord>& bottom,
+                           const pmr::vector<Coord>& right,
+                           const uint32_t* index) {
+        BaseView v = { top.data(), left.data(), bottom.data(), right.data(),
+                       index };
+        return v;
     }
 };
 
@@ -153,189 +918,958 @@ private:
    Represents a single node in the 2D tree.
 
    - Extent: the rectangular region covered by this node.
+   - SplitX, SplitY: its center lines, the vertical line x = SplitX
+     and the horizontal line y = SplitY (see SplitPolicy).
    - Vertical: rectangles intersecting the vertical center line.
    - Horizontal: rectangles intersecting the horizontal center line.
+     (both contiguous RectBuckets, indexed along the free axis)
+   - Leaf: not split yet; all its rectangles are in Vertical and it
+     has no children.
    - Four child pointers representing the four quadrants:
        TopLeft, TopRight, BottomLeft, BottomRight.
+   - Parent (nullptr at the root), Depth (0 at the root) and Count,
+     the number of rectangles in this subtree, so that remove can
+     walk up and unlink subtrees that became empty.
+
+   Nodes and their buckets live in the tree's Arena; the tree
+   destroys them, a node does not own its children.
  */
 template <class T>
 class TwoDimTreeNode {
 public:
-    Rectangle Extent;
-    List<T> Vertical;
-    List<T> Horizontal;
+    typedef typename RectTraits<T>::Coord Coord;
+
+    BasicRectangle<Coord> Extent;
+    Coord SplitX;
+    Coord SplitY;
+    RectBucket<T> Vertical;
+    RectBucket<T> Horizontal;
+    bool Leaf;
 
     TwoDimTreeNode<T>* TopLeft;
     TwoDimTreeNode<T>* TopRight;
     TwoDimTreeNode<T>* BottomLeft;
     TwoDimTreeNode<T>* BottomRight;
 
-    TwoDimTreeNode(const Rectangle& e)
-        : Extent(e),
+    TwoDimTreeNode<T>* Parent;
+    unsigned Depth;
+    size_t Count;
+
+    TwoDimTreeNode(const BasicRectangle<Coord>& e, TwoDimTreeNode<T>* parent,
+                   pmr::memory_resource* memory)
+        : Vertical(RectBucket<T>::BY_TOP, memory),
+          Horizontal(RectBucket<T>::BY_LEFT, memory),
           TopLeft(nullptr), TopRight(nullptr),
-          BottomLeft(nullptr), BottomRight(nullptr) {}
+          BottomLeft(nullptr), BottomRight(nullptr),
+          Count(0) {
+        reset(e, parent);
+    }
 
-    ~TwoDimTreeNode() {
-        delete TopLeft;
-        delete TopRight;
-        delete BottomLeft;
-        delete BottomRight;
+    // Makes this an empty leaf covering e (buckets and children
+    // must be empty already).
+    void reset(const BasicRectangle<Coord>& e, TwoDimTreeNode<T>* parent) {
+        Extent = e;
+        SplitX = CoordTraits<Coord>::mid(e.Left, e.Right);
+        SplitY = CoordTraits<Coord>::mid(e.Top, e.Bottom);
+        Leaf = true;
+        Parent = parent;
+        Depth = parent ? parent->Depth + 1 : 0;
     }
 };
 
+/* 
+   QueryPoint / BatchResult
+   Input and output of TwoDimTree::searchBatch. The result is in
+   compressed sparse row form: the hits of query i are
+   hits[offsets[i]] .. hits[offsets[i + 1] - 1].
+ */
+template <class Coord>
+struct BasicQueryPoint {
+    Coord x;
+    Coord y;
+};
+
+typedef BasicQueryPoint<int> QueryPoint;
+
+template <class T>
+struct BatchResult {
+    vector<size_t> offsets;     // one more entry than there are queries
+    vector<T> hits;
+
+    size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+    const T* begin(size_t i) const { return hits.data() + offsets[i]; }
+    const T* end(size_t i) const { return hits.data() + offsets[i + 1]; }
+};
+
+/* 
+   SplitPolicy
+   How a TwoDimTree shapes itself. The defaults give the classic
+   tree: every node is split at the midpoint of its extent as soon
+   as a rectangle reaches it, down to extents one unit wide.
+
+   - leafCapacity: a node keeps up to this many rectangles unsplit,
+     in one bucket. One more and it splits, its rectangles moving
+     down to where they belong, so sparse areas get a few full
+     nodes instead of long chains of nearly empty ones.
+   - maxDepth: nodes at this depth (the root is 0) never split,
+     which bounds the length of every descent.
+   - medianSplit: a node splits at the medians of its rectangles'
+     centers (x and y) instead of at the midpoint of its extent, so
+     quadrants follow the data. A node only knows the rectangles it
+     holds when it splits: this wants a leafCapacity of a few dozen
+     or more (a bulk load sees all of them).
+ */
+struct SplitPolicy {
+    size_t leafCapacity;
+    unsigned maxDepth;
+    bool medianSplit;
+
+    SplitPolicy(size_t capacity = 0, unsigned depth = UINT_MAX,
+                bool median = false)
+        : leafCapacity(capacity), maxDepth(depth), medianSplit(median) {}
+};
+
 /* 
    TwoDimTree
    Stores rectangles and supports searching for all rectangles
    containing a given point (x,y).
    Rectangles are inserted according to whether they intersect
-   the node's center lines or fall entirely inside one quadrant.
+   the node's center lines or fall entirely inside one quadrant;
+   where those lines are and when a node splits is up to the
+   tree's SplitPolicy.
+
+   Every stored rectangle has an id (returned by insert; the bulk
+   load gives rects[i] id i). The handle table maps an id to the
+   node, bucket and slot holding it, so remove and update go
+   straight there instead of searching. Ids of removed rectangles
+   are handed out again by later inserts.
  */
 template <class T>
 class TwoDimTree {
+public:
+    // This tree's coordinate type and its rectangles and query points
+    // (the global Rectangle and QueryPoint are the int ones)
+    typedef typename RectTraits<T>::Coord Coord;
+    typedef BasicRectangle<Coord> Rectangle;
+    typedef BasicQueryPoint<Coord> QueryPoint;
+
+    typedef uint32_t Id;
+
 private:
+    friend class TwoDimSnapshot<T>;
+    friend class ConcurrentTwoDimTree<T>;
+
+    /* Where a rectangle is stored; node is nullptr for a free id. */
+    struct Handle {
+        TwoDimTreeNode<T>* node;
+        uint32_t slot;
+        unsigned char bucket;   // VERTICAL or HORIZONTAL
+    };
+
+    SplitPolicy policy;
+    Arena arena;                // nodes and buckets, freed all at once
     TwoDimTreeNode<T>* root;
+    vector<Handle> handles;     // indexed by id
+    vector<Id> freeIds;
+    vector<TwoDimTreeNode<T>*> spare;   // unlinked nodes, reused first
+
+    /* Creates a node in the arena, or recycles an unlinked one. */
+    TwoDimTreeNode<T>* newNode(const Rectangle& e, TwoDimTreeNode<T>* parent) {
+        if (!spare.empty()) {
+            TwoDimTreeNode<T>* node = spare.back();
+            spare.pop_back();
+            node->reset(e, parent);
+            return node;
+        }
+
+        void* p = arena.allocate(sizeof(TwoDimTreeNode<T>),
+                                 alignof(TwoDimTreeNode<T>));
+        return new (p) TwoDimTreeNode<T>(e, parent, &arena);
+    }
+
+    /* Runs the destructors of node and its descendants
+       (their memory stays in the arena). */
+    void destroy(TwoDimTreeNode<T>* node) {
+        if (!node) return;
+
+        destroy(node->TopLeft);
+        destroy(node->TopRight);
+        destroy(node->BottomLeft);
+        destroy(node->BottomRight);
+        node->~TwoDimTreeNode<T>();
+    }
 
     /* 
-       INSERT OPERATION
-       Places rectangle R in the correct subtree:
+       Placement of a rectangle relative to a node:
+       one of its two buckets or one of the four quadrants.
+     */
+    enum Place { VERTICAL, HORIZONTAL,
+                 TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT };
+
+    /* 
+       Decides where rectangle R goes in node:
 
-       1. Compute center lines of current node.
-       2. If rectangle intersects vertical center line → store in Vertical.
-       3. Else if intersects horizontal center line → store in Horizontal.
-       4. Else descend into the appropriate quadrant subtree.
-       5. If extent cannot be subdivided further → store locally.
+       1. If the node is a leaf → store locally.
+       2. If rectangle intersects vertical center line → Vertical.
+       3. Else if intersects horizontal center line → Horizontal.
+       4. Else the quadrant that contains it entirely.
      */
-    void insert(const T& R, TwoDimTreeNode<T>* node) {
-        int centerX = (node->Extent.Left + node->Extent.Right) / 2;
-        int centerY = (node->Extent.Top  + node->Extent.Bottom) / 2;
-
-        // If the region is too small to subdivide, store rectangle here.
-        if ((node->Extent.Right  - node->Extent.Left)  <= 1 ||
-            (node->Extent.Bottom - node->Extent.Top)   <= 1) {
-            node->Vertical.insertAtEnd(R);
-            return;
-        }
+    static Place place(const T& R, const TwoDimTreeNode<T>* node) {
+        if (node->Leaf)
+            return VERTICAL;
+        return place(R, node->SplitX, node->SplitY);
+    }
 
+    static Place place(const T& R, Coord centerX, Coord centerY) {
         // Check intersection with vertical center line
-        if (R.Left <= centerX && R.Right > centerX) {
-            node->Vertical.insertAtEnd(R);
-            return;
-        }
+        if (R.Left <= centerX && R.Right > centerX)
+            return VERTICAL;
 
         // Check intersection with horizontal center line
-        if (R.Top <= centerY && R.Bottom > centerY) {
-            node->Horizontal.insertAtEnd(R);
+        if (R.Top <= centerY && R.Bottom > centerY)
+            return HORIZONTAL;
+
+        // Otherwise rectangle belongs fully to one quadrant:
+        if (R.Right <= centerX && R.Bottom <= centerY)
+            return TOP_LEFT;
+        if (R.Left > centerX && R.Bottom <= centerY)
+            return TOP_RIGHT;
+        if (R.Right <= centerX && R.Top > centerY)
+            return BOTTOM_LEFT;
+        return BOTTOM_RIGHT;
+    }
+
+    /* The part of extent E covered by quadrant q
+       (the center lines themselves belong to no quadrant). */
+    static Rectangle quadrant(const Rectangle& E, Coord centerX, Coord centerY,
+                              Place q) {
+        // First cells past the center lines
+        Coord right = centerX + CoordTraits<Coord>::CELL;
+        Coord below = centerY + CoordTraits<Coord>::CELL;
+
+        switch (q) {
+        case TOP_LEFT:
+            return Rectangle(E.Top, E.Left, centerY, centerX);
+        case TOP_RIGHT:
+            return Rectangle(E.Top, right, centerY, E.Right);
+        case BOTTOM_LEFT:
+            return Rectangle(below, E.Left, E.Bottom, centerX);
+        default:
+            return Rectangle(below, right, E.Bottom, E.Right);
+        }
+    }
+
+    // An extent is subdivided while its midpoints lie strictly inside
+    // (for integers: while it is more than one cell wide and high).
+    static bool divisible(const Rectangle& E) {
+        Coord centerX = CoordTraits<Coord>::mid(E.Left, E.Right);
+        Coord centerY = CoordTraits<Coord>::mid(E.Top, E.Bottom);
+        return E.Left < centerX && centerX < E.Right &&
+               E.Top < centerY && centerY < E.Bottom;
+    }
+
+    bool maySplit(const TwoDimTreeNode<T>* node) const {
+        return node->Depth < policy.maxDepth && divisible(node->Extent);
+    }
+
+    /* 
+       Fixes the center lines of node for its rectangles [0, n):
+       the midpoint of the extent, or with medianSplit the median
+       centers of the rectangles, kept inside the extent.
+     */
+    void chooseSplit(TwoDimTreeNode<T>* node, const T* rects, size_t n) const {
+        const Rectangle& E = node->Extent;
+        node->SplitX = CoordTraits<Coord>::mid(E.Left, E.Right);
+        node->SplitY = CoordTraits<Coord>::mid(E.Top, E.Bottom);
+        if (!policy.medianSplit || n == 0)
             return;
+
+        vector<Coord> xs(n), ys(n);
+        for (size_t i = 0; i < n; ++i) {
+            xs[i] = rects[i].Left + (rects[i].Right - rects[i].Left) / 2;
+            ys[i] = rects[i].Top + (rects[i].Bottom - rects[i].Top) / 2;
         }
+        nth_element(xs.begin(), xs.begin() + n / 2, xs.end());
+        nth_element(ys.begin(), ys.begin() + n / 2, ys.end());
 
-        // Otherwise rectangle belongs fully to one quadrant:
+        // Last cells of the extent
+        Coord lastX = E.Right - CoordTraits<Coord>::CELL;
+        Coord lastY = E.Bottom - CoordTraits<Coord>::CELL;
+        node->SplitX = min(max(xs[n / 2], E.Left), lastX);
+        node->SplitY = min(max(ys[n / 2], E.Top), lastY);
+    }
 
-        // TOP LEFT quadrant
-        if (R.Right <= centerX && R.Bottom <= centerY) {
-            if (!node->TopLeft) {
-                Rectangle e(node->Extent.Top, node->Extent.Left,
-                            centerY, centerX);
-                node->TopLeft = new TwoDimTreeNode<T>(e);
-            }
-            insert(R, node->TopLeft);
-        }
-        // TOP RIGHT quadrant
-        else if (R.Left > centerX && R.Bottom <= centerY) {
-            if (!node->TopRight) {
-                Rectangle e(node->Extent.Top, centerX + 1,
-                            centerY, node->Extent.Right);
-                node->TopRight = new TwoDimTreeNode<T>(e);
-            }
-            insert(R, node->TopRight);
-        }
-        // BOTTOM LEFT quadrant
-        else if (R.Right <= centerX && R.Top > centerY) {
-            if (!node->BottomLeft) {
-                Rectangle e(centerY + 1, node->Extent.Left,
-                            node->Extent.Bottom, centerX);
-                node->BottomLeft = new TwoDimTreeNode<T>(e);
+    /* 
+       SPLIT
+       Turns leaf node into an inner one: fixes its center lines and
+       moves the rectangles of its bucket down to where they belong
+       now (in slot order, so buckets below get them in insertion
+       order). R, the rectangle on its way in, counts for the median.
+     */
+    void split(TwoDimTreeNode<T>* node, const T& R) {
+        RectBucket<T>& b = node->Vertical;
+        vector<T> rects;
+        vector<Id> ids;
+        rects.reserve(b.size() + 1);
+        ids.reserve(b.size());
+        for (size_t slot = 0; slot < b.slots(); ++slot) {
+            if (b.id(slot) != RectBucket<T>::DEAD) {
+                rects.push_back(b.item(slot));
+                ids.push_back(b.id(slot));
             }
-            insert(R, node->BottomLeft);
-        }
-        // BOTTOM RIGHT quadrant
-        else {
-            if (!node->BottomRight) {
-                Rectangle e(centerY + 1, centerX + 1,
-                            node->Extent.Bottom, node->Extent.Right);
-                node->BottomRight = new TwoDimTreeNode<T>(e);
+        }
+        rects.push_back(R);
+        chooseSplit(node, rects.data(), rects.size());
+        rects.pop_back();
+
+        b.clear();
+        node->Leaf = false;
+        node->Count -= rects.size();    // insert counts them again
+        for (size_t i = 0; i < rects.size(); ++i)
+            insert(rects[i], ids[i], node);
+    }
+
+    /* 
+       Returns the child of node for quadrant q,
+       creating it with the matching part of the extent if needed.
+     */
+    TwoDimTreeNode<T>* child(TwoDimTreeNode<T>* node, Place q) {
+        TwoDimTreeNode<T>** slot;
+        switch (q) {
+        case TOP_LEFT:    slot = &node->TopLeft; break;
+        case TOP_RIGHT:   slot = &node->TopRight; break;
+        case BOTTOM_LEFT: slot = &node->BottomLeft; break;
+        default:          slot = &node->BottomRight; break;
+        }
+
+        if (!*slot)
+            *slot = newNode(quadrant(node->Extent, node->SplitX,
+                                     node->SplitY, q), node);
+        return *slot;
+    }
+
+    /* 
+       INSERT OPERATION
+       Places rectangle R with the given id in the correct subtree:
+       stores it in a bucket of the first node where it meets a
+       center line (see place), descending through the quadrants.
+       A leaf that would hold more than leafCapacity rectangles is
+       split on the way.
+     */
+    void insert(const T& R, Id id, TwoDimTreeNode<T>* node) {
+        for (;;) {
+            ++node->Count;
+            if (node->Leaf && node->Count > policy.leafCapacity &&
+                maySplit(node))
+                split(node, R);
+            Place p = place(R, node);
+            if (p == VERTICAL || p == HORIZONTAL) {
+                RectBucket<T>& b = p == VERTICAL ? node->Vertical
+                                                 : node->Horizontal;
+                Handle h = { node, b.add(R, id),
+                             static_cast<unsigned char>(p) };
+                handles[id] = h;
+                return;
             }
-            insert(R, node->BottomRight);
+            node = child(node, p);
+        }
+    }
+
+    /* A fresh id (a free one if there is any) with a handle entry. */
+    Id newId() {
+        if (!freeIds.empty()) {
+            Id id = freeIds.back();
+            freeIds.pop_back();
+            return id;
         }
+        Handle h = { nullptr, 0, 0 };
+        handles.push_back(h);
+        return static_cast<Id>(handles.size() - 1);
     }
 
     /* 
-       SEARCH OPERATION
-       Searches for all rectangles containing point (x,y):
+       REMOVE OPERATION
+       Takes the rectangle out of its bucket (the handle says where),
+       then walks up lowering the counts. Each node left without any
+       rectangle in its subtree is unlinked from its parent and kept
+       for reuse by newNode, so churn does not grow the arena.
+     */
+    void erase(Id id) {
+        Handle h = handles[id];
+        handles[id].node = nullptr;
 
-       1. Test all rectangles stored in Vertical and Horizontal lists.
-       2. If point lies on center lines → do not descend further.
-       3. Else recursively search the child quadrant that contains (x,y).
+        auto moved = [this](uint32_t other, uint32_t slot) {
+            handles[other].slot = slot;
+        };
+        RectBucket<T>& b = h.bucket == VERTICAL ? h.node->Vertical
+                                                : h.node->Horizontal;
+        b.remove(h.slot, moved);
+
+        for (TwoDimTreeNode<T>* n = h.node; n; n = n->Parent)
+            --n->Count;
+
+        TwoDimTreeNode<T>* node = h.node;
+        while (node != root && node->Count == 0) {
+            TwoDimTreeNode<T>* parent = node->Parent;
+            if (parent->TopLeft == node)
+                parent->TopLeft = nullptr;
+            else if (parent->TopRight == node)
+                parent->TopRight = nullptr;
+            else if (parent->BottomLeft == node)
+                parent->BottomLeft = nullptr;
+            else
+                parent->BottomRight = nullptr;
+
+            // Its children were unlinked before it, being empty too
+            node->Vertical.clear();
+            node->Horizontal.clear();
+            spare.push_back(node);
+            node = parent;
+        }
+    }
+
+    /* 
+       BULK LOAD
+       Distributes rects [0, n) of src, with ids srcIds, over node
+       and its subtree.
+
+       A node that gets more than leafCapacity rectangles (and may
+       split) is split first, with the medians of all of them. Then
+       one pass classifies every rectangle, a second one scatters them
+       into dst grouped by placement (stable, so each bucket receives
+       its rectangles in input order, exactly as repeated insert would).
+       The buckets are filled in one go and each quadrant's group is
+       loaded recursively with src and dst swapped; the groups are
+       disjoint ranges, so quadrants are loaded in parallel while
+       `threads` allows it.
      */
-    void search(int x, int y, TwoDimTreeNode<T>* node,
-                List<T>& result) const {
-        if (!node) return;
+    void load(TwoDimTreeNode<T>* node, T* src, T* dst,
+              Id* srcIds, Id* dstIds, size_t n, unsigned threads) {
+        if (n == 0)
+            return;
+        node->Count = n;
+        if (n > policy.leafCapacity && maySplit(node)) {
+            chooseSplit(node, src, n);
+            node->Leaf = false;
+        }
 
-        // Check rectangles intersecting vertical center line
-        for (ListItr<T> it = node->Vertical.first();
-             !it.isPastEnd(); it.advance()) {
-            if (it.retrieve().contains(x, y))
-                result.insertAtEnd(it.retrieve());
+        vector<unsigned char> places(n);
+        size_t counts[6] = { 0, 0, 0, 0, 0, 0 };
+        for (size_t i = 0; i < n; ++i) {
+            places[i] = static_cast<unsigned char>(place(src[i], node));
+            ++counts[places[i]];
         }
 
-        // Check rectangles intersecting horizontal center line
-        for (ListItr<T> it = node->Horizontal.first();
-             !it.isPastEnd(); it.advance()) {
-            if (it.retrieve().contains(x, y))
-                result.insertAtEnd(it.retrieve());
+        size_t offsets[6];
+        size_t begin[6];
+        size_t next = 0;
+        for (int g = 0; g < 6; ++g) {
+            offsets[g] = begin[g] = next;
+            next += counts[g];
         }
+        for (size_t i = 0; i < n; ++i) {
+            size_t to = offsets[places[i]]++;
+            dst[to] = src[i];
+            dstIds[to] = srcIds[i];
+        }
+        vector<unsigned char>().swap(places);
 
-        int centerX = (node->Extent.Left + node->Extent.Right) / 2;
-        int centerY = (node->Extent.Top  + node->Extent.Bottom) / 2;
+        // Bucket slots follow the grouped order; ids are distinct, so
+        // parallel loads write disjoint handles
+        for (int g = VERTICAL; g <= HORIZONTAL; ++g) {
+            RectBucket<T>& b = g == VERTICAL ? node->Vertical : node->Horizontal;
+            b.addAll(dst + begin[g], dstIds + begin[g], counts[g]);
+            for (size_t i = 0; i < counts[g]; ++i) {
+                Handle h = { node, static_cast<uint32_t>(i),
+                             static_cast<unsigned char>(g) };
+                handles[dstIds[begin[g] + i]] = h;
+            }
+        }
 
-        // If point lies on center lines, no further search needed.
-        if (x == centerX || y == centerY)
+        // With threads to spare, every non-empty quadrant but the last
+        // gets a thread of its own and a share of the thread budget
+        unsigned busy = 0;
+        for (int g = TOP_LEFT; g <= BOTTOM_RIGHT; ++g)
+            busy += counts[g] > 0;
+        if (busy == 0)
             return;
+        unsigned share = threads / busy > 1 ? threads / busy : 1;
+        bool parallel = threads > 1 && n >= PARALLEL_MIN;
 
-        // Search the appropriate quadrant.
-        if (x < centerX && y < centerY) {
-            search(x, y, node->TopLeft, result);
+        vector<thread> workers;
+        for (int g = TOP_LEFT; g <= BOTTOM_RIGHT; ++g) {
+            if (counts[g] == 0)
+                continue;
+
+            TwoDimTreeNode<T>* c = child(node, static_cast<Place>(g));
+            T* from = dst + begin[g];
+            T* scratch = src + begin[g];
+            Id* fromIds = dstIds + begin[g];
+            Id* scratchIds = srcIds + begin[g];
+
+            if (parallel && --busy > 0)
+                workers.emplace_back(&TwoDimTree::load, this, c, from, scratch,
+                                     fromIds, scratchIds, counts[g], share);
+            else
+                load(c, from, scratch, fromIds, scratchIds, counts[g], share);
         }
-        else if (x > centerX && y < centerY) {
-            search(x, y, node->TopRight, result);
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    // Smallest group worth a thread of its own
+    static const size_t PARALLEL_MIN = 1 << 14;
+
+    /* 
+       SEARCH OPERATION
+       Calls visitor(R) for every rectangle R containing point (x,y):
+
+       1. Test all rectangles stored in Vertical and Horizontal buckets.
+       2. If point lies on center lines → do not descend further.
+       3. Else continue with the child quadrant that contains (x,y).
+
+       Only one child is followed per level, so the descent is a loop
+       and nothing is copied or allocated.
+     */
+    template <class Visitor>
+    void visit(Coord x, Coord y, const TwoDimTreeNode<T>* node,
+               Visitor& visitor) const {
+        while (node) {
+            // Check rectangles intersecting vertical center line
+            node->Vertical.visitContaining(x, y, visitor);
+
+            // Check rectangles intersecting horizontal center line
+            node->Horizontal.visitContaining(x, y, visitor);
+
+            Coord centerX = node->SplitX;
+            Coord centerY = node->SplitY;
+
+            // If point lies on center lines, no further search needed.
+            if (x == centerX || y == centerY)
+                return;
+
+            // Continue in the appropriate quadrant.
+            if (x < centerX && y < centerY)
+                node = node->TopLeft;
+            else if (x > centerX && y < centerY)
+                node = node->TopRight;
+            else if (x < centerX && y > centerY)
+                node = node->BottomLeft;
+            else
+                node = node->BottomRight;
         }
-        else if (x < centerX && y > centerY) {
-            search(x, y, node->BottomLeft, result);
+    }
+
+    /* 
+       WINDOW SEARCH
+       Visits every rectangle overlapping window W. Subtrees whose
+       extent misses W are skipped, and each bucket only tests the
+       rectangles its interval index places in the window's range.
+     */
+    template <class Visitor>
+    void visitIntersecting(const Rectangle& W, const TwoDimTreeNode<T>* node,
+                           Visitor& visitor) const {
+        if (!node) return;
+
+        const Rectangle& E = node->Extent;
+        if (E.Left >= W.Right || W.Left >= E.Right ||
+            E.Top >= W.Bottom || W.Top >= E.Bottom)
+            return;
+
+        node->Vertical.visitIntersecting(W, visitor);
+        node->Horizontal.visitIntersecting(W, visitor);
+
+        visitIntersecting(W, node->TopLeft, visitor);
+        visitIntersecting(W, node->TopRight, visitor);
+        visitIntersecting(W, node->BottomLeft, visitor);
+        visitIntersecting(W, node->BottomRight, visitor);
+    }
+
+    /* 
+       BATCH SEARCH
+       Searches a group of points together: every node on the way is
+       visited once for the whole group, whose points are then split
+       over the quadrants (points on a center line stop here).
+       For each hit, hit(query index, rectangle) is called; per query,
+       hits come in the same order as in a single search.
+     */
+    template <class Hit>
+    void searchGroup(const TwoDimTreeNode<T>* node, uint32_t* ids, size_t n,
+                     const QueryPoint* points, Hit& hit) const {
+        if (!node || n == 0)
+            return;
+
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t id = ids[i];
+            auto visitor = [&hit, id](const T& R) { hit(id, R); };
+            node->Vertical.visitContaining(points[id].x, points[id].y, visitor);
+            node->Horizontal.visitContaining(points[id].x, points[id].y, visitor);
         }
-        else {
-            search(x, y, node->BottomRight, result);
+
+        Coord centerX = node->SplitX;
+        Coord centerY = node->SplitY;
+
+        // Drop points on a center line, then split the rest by quadrant
+        uint32_t* end = partition(ids, ids + n, [&](uint32_t id) {
+            return points[id].x != centerX && points[id].y != centerY;
+        });
+        uint32_t* top = partition(ids, end, [&](uint32_t id) {
+            return points[id].y < centerY;
+        });
+        uint32_t* topLeft = partition(ids, top, [&](uint32_t id) {
+            return points[id].x < centerX;
+        });
+        uint32_t* bottomLeft = partition(top, end, [&](uint32_t id) {
+            return points[id].x < centerX;
+        });
+
+        searchGroup(node->TopLeft, ids, topLeft - ids, points, hit);
+        searchGroup(node->TopRight, topLeft, top - topLeft, points, hit);
+        searchGroup(node->BottomLeft, top, bottomLeft - top, points, hit);
+        searchGroup(node->BottomRight, bottomLeft, end - bottomLeft, points,
+                    hit);
+    }
+
+    /* Position of v in [lo, hi] as 32 bits, for the Morton key:
+       the offset itself for integers of up to 32 bits, scaled to
+       the range otherwise. */
+    static uint32_t mortonCoord(Coord v, Coord lo, Coord hi) {
+        if (is_integral<Coord>::value && sizeof(Coord) <= 4)
+            return static_cast<uint32_t>(v) - static_cast<uint32_t>(lo);
+
+        double f = (double(v) - double(lo)) / (double(hi) - double(lo));
+        if (!(f > 0))
+            return 0;
+        if (f >= 1)
+            return UINT32_MAX;
+        return static_cast<uint32_t>(f * 4294967295.0);
+    }
+
+    /* Interleaves the bits of x and y (Morton / Z-order key). */
+    static uint64_t mortonKey(uint32_t x, uint32_t y) {
+        uint64_t key = 0;
+        for (int bit = 0; bit < 32; ++bit) {
+            key |= static_cast<uint64_t>((x >> bit) & 1) << (2 * bit);
+            key |= static_cast<uint64_t>((y >> bit) & 1) << (2 * bit + 1);
         }
+        return key;
+    }
+
+    // Queries per batch task
+    static constexpr size_t BATCH_CHUNK = 4096;
+
+    /* Compacts the buckets of node and all its descendants. */
+    void compact(TwoDimTreeNode<T>* node) {
+        if (!node) return;
+
+        node->Vertical.compact();
+        node->Horizontal.compact();
+        compact(node->TopLeft);
+        compact(node->TopRight);
+        compact(node->BottomLeft);
+        compact(node->BottomRight);
     }
 
 public:
 
     /* Constructor: initializes tree with given extent rectangle. */
-    TwoDimTree(const Rectangle& r) {
-        root = new TwoDimTreeNode<T>(r);
+    TwoDimTree(const Rectangle& r, const SplitPolicy& shape = SplitPolicy())
+        : policy(shape) {
+        root = newNode(r, nullptr);
+    }
+
+    /* Bulk-load constructor: builds the tree for all of rects at once
+       (same result as inserting them in order, then compact(); with
+       medianSplit the medians come from all rectangles, so nodes may
+       split elsewhere).
+       threads: how many threads may share the work, 0 = one per core. */
+    TwoDimTree(const Rectangle& r, const vector<T>& rects,
+               unsigned threads = 0, const SplitPolicy& shape = SplitPolicy())
+        : policy(shape) {
+        root = newNode(r, nullptr);
+
+        if (threads == 0)
+            threads = thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+
+        vector<T> src(rects), dst(rects);   // dst: scratch of the same size
+        vector<Id> srcIds(rects.size()), dstIds(rects.size());
+        for (size_t i = 0; i < srcIds.size(); ++i)
+            srcIds[i] = static_cast<Id>(i);
+
+        handles.resize(rects.size());
+        load(root, src.data(), dst.data(), srcIds.data(), dstIds.data(),
+             src.size(), threads);
     }
 
-    /* Destructor: recursively deletes entire tree. */
+    /* Destructor: releases the arena, which frees every node and
+       bucket in one step. Only a T with a destructor of its own
+       makes it walk the tree first. */
     ~TwoDimTree() {
-        delete root;
+        if (!is_trivially_destructible<T>::value) {
+            destroy(root);
+            for (size_t i = 0; i < spare.size(); ++i)
+                spare[i]->~TwoDimTreeNode<T>();
+        }
     }
 
-    /* Public insert function. */
-    void insert(const T& R) {
-        insert(R, root);
+    TwoDimTree(const TwoDimTree&) = delete;
+    TwoDimTree& operator=(const TwoDimTree&) = delete;
+
+    /* Public insert function; returns the new rectangle's id. */
+    Id insert(const T& R) {
+        Id id = newId();
+        insert(R, id, root);
+        return id;
     }
 
-    /* Public search function. */
-    void search(int x, int y, List<T>& result) const {
-        search(x, y, root, result);
+    /* 
+       remove / update
+       O(depth + bucket size) through the handle table.
+       remove : takes rectangle id out of the tree; returns false if
+                id is not in use. The id becomes free.
+       update : replaces rectangle id with R (possibly elsewhere in
+                the tree); the id stays the same. Returns false if id
+                is not in use.
+       get    : the rectangle with id, or nullptr if id is not in use
+                (valid until the next change to the tree).
+     */
+    bool remove(Id id) {
+        if (id >= handles.size() || !handles[id].node)
+            return false;
+        erase(id);
+        freeIds.push_back(id);
+        return true;
+    }
+
+    bool update(Id id, const T& R) {
+        if (id >= handles.size() || !handles[id].node)
+            return false;
+        erase(id);
+        insert(R, id, root);
+        return true;
+    }
+
+    const T* get(Id id) const {
+        if (id >= handles.size() || !handles[id].node)
+            return nullptr;
+        const Handle& h = handles[id];
+        return &(h.bucket == VERTICAL ? h.node->Vertical
+                                      : h.node->Horizontal).item(h.slot);
+    }
+
+    /* Number of rectangles stored. */
+    size_t size() const { return root->Count; }
+
+    /* Sorts every bucket's recent inserts into its index
+       (call once after loading; queries are correct either way). */
+    void compact() {
+        compact(root);
+    }
+
+    /* 
+       Query functions
+       All report the rectangles containing point (x,y), in the same
+       order: root to leaf, Vertical before Horizontal in each node
+       (within a bucket, see RectBucket::visitContaining).
+
+       visit  : calls visitor(const T&) for each one (no copies)
+       count  : only counts them
+       search : appends them to a caller-owned vector (reuse it across
+                queries and no allocation happens once it has grown)
+                or to a List
+     */
+    template <class Visitor>
+    void visit(Coord x, Coord y, Visitor&& visitor) const {
+        visit(x, y, root, visitor);
+    }
+
+    size_t count(Coord x, Coord y) const {
+        size_t n = 0;
+        visit(x, y, [&n](const T&) { ++n; });
+        return n;
+    }
+
+    void search(Coord x, Coord y, vector<T>& result) const {
+        visit(x, y, [&result](const T& R) { result.push_back(R); });
+    }
+
+    void search(Coord x, Coord y, List<T>& result) const {
+        visit(x, y, [&result](const T& R) { result.insertAtEnd(R); });
+    }
+
+    /* 
+       Window and nearest queries
+       (both assume the rectangles lie inside the root extent, as
+       insert does)
+
+       visitIntersecting : calls visitor(const T&) for every rectangle
+                           overlapping W (edges half-open)
+       searchWindow      : appends those rectangles to result
+       nearest           : the k rectangles closest to (x,y), nearest
+                           first (squaredDistance; ties in any order)
+     */
+    template <class Visitor>
+    void visitIntersecting(const Rectangle& W, Visitor&& visitor) const {
+        if (W.Left < W.Right && W.Top < W.Bottom)
+            visitIntersecting(W, root, visitor);
+    }
+
+    void searchWindow(const Rectangle& W, vector<T>& result) const {
+        visitIntersecting(W, [&result](const T& R) { result.push_back(R); });
+    }
+
+    /* 
+       Best-first search: nodes are taken from a min-heap ordered by
+       the distance to their extent, which bounds the distance of
+       every rectangle below them. The k best rectangles so far are
+       kept in a max-heap; once the nearest open node is no closer
+       than the k-th best, nothing left can improve the answer.
+     */
+    void nearest(Coord x, Coord y, size_t k, vector<T>& result) const {
+        result.clear();
+        if (k == 0)
+            return;
+
+        typedef pair<double, const TwoDimTreeNode<T>*> NodeEntry;
+        priority_queue<NodeEntry, vector<NodeEntry>, greater<NodeEntry> > open;
+
+        vector<pair<double, T> > best;    // max-heap on distance
+        auto farther = [](const pair<double, T>& a, const pair<double, T>& b) {
+            return a.first < b.first;
+        };
+        double bound = numeric_limits<double>::infinity();
+
+        auto consider = [&](const T& R, double d) {
+            if (best.size() == k) {
+                pop_heap(best.begin(), best.end(), farther);
+                best.pop_back();
+            }
+            best.push_back(make_pair(d, R));
+            push_heap(best.begin(), best.end(), farther);
+            if (best.size() == k)
+                bound = best.front().first;
+        };
+
+        const Rectangle& RE = root->Extent;
+        open.push(NodeEntry(squaredDistance(x, y, RE.Top, RE.Left,
+                                            RE.Bottom, RE.Right), root));
+
+        while (!open.empty() && open.top().first < bound) {
+            const TwoDimTreeNode<T>* node = open.top().second;
+            open.pop();
+
+            node->Vertical.visitNear(x, y, bound, consider);
+            node->Horizontal.visitNear(x, y, bound, consider);
+
+            const TwoDimTreeNode<T>* children[4] = {
+                node->TopLeft, node->TopRight,
+                node->BottomLeft, node->BottomRight
+            };
+            for (int c = 0; c < 4; ++c) {
+                if (!children[c])
+                    continue;
+                const Rectangle& E = children[c]->Extent;
+                double d = squaredDistance(x, y, E.Top, E.Left,
+                                           E.Bottom, E.Right);
+                if (d < bound)
+                    open.push(NodeEntry(d, children[c]));
+            }
+        }
+
+        sort_heap(best.begin(), best.end(), farther);
+        for (size_t i = 0; i < best.size(); ++i)
+            result.push_back(best[i].second);
+    }
+
+    /* 
+       searchBatch
+       Answers all points at once into out (CSR form, see BatchResult).
+
+       The points are sorted in Morton (Z) order so that neighbours,
+       which share most of their path, end up in the same chunk; each
+       chunk descends the tree as one group (searchGroup). Chunks are
+       spread over the threads of pool, which the caller keeps for
+       many batches (and uses from one thread at a time); the tree is
+       only read.
+
+       Without a pool, one of `threads` threads (0 = one per core) is
+       started for this batch alone.
+     */
+    void searchBatch(const vector<QueryPoint>& points, BatchResult<T>& out,
+                     unsigned threads = 0) const {
+        ThreadPool pool(threads);
+        searchBatch(points, out, pool);
+    }
+
+    void searchBatch(const vector<QueryPoint>& points, BatchResult<T>& out,
+                     ThreadPool& pool) const {
+        size_t n = points.size();
+        const Rectangle& E = root->Extent;
+
+        // Morton order relative to the root extent
+        vector<pair<uint64_t, uint32_t> > keyed(n);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t dx = mortonCoord(points[i].x, E.Left, E.Right);
+            uint32_t dy = mortonCoord(points[i].y, E.Top, E.Bottom);
+            keyed[i] = make_pair(mortonKey(dx, dy), static_cast<uint32_t>(i));
+        }
+        sort(keyed.begin(), keyed.end());
+
+        vector<uint32_t> order(n);
+        for (size_t i = 0; i < n; ++i)
+            order[i] = keyed[i].second;
+        vector<pair<uint64_t, uint32_t> >().swap(keyed);
+
+        /*
+           Two passes over the chunks, in parallel: the first counts the
+           hits of every query, which gives the offsets; the second
+           writes each hit straight into its final place. Every query
+           belongs to one chunk, so no two threads write the same
+           counter or hit slot.
+         */
+        size_t chunks = (n + BATCH_CHUNK - 1) / BATCH_CHUNK;
+        out.offsets.assign(n + 1, 0);
+
+        size_t* counts = out.offsets.data() + 1;
+        vector<const T*> firstHits(chunks, nullptr);   // any hit of a chunk
+        pool.parallelFor(chunks, [&](size_t c) {
+            const T*& first = firstHits[c];
+            auto hit = [counts, &first](uint32_t id, const T& R) {
+                ++counts[id];
+                if (!first)
+                    first = &R;
+            };
+            size_t from = c * BATCH_CHUNK;
+            searchGroup(root, order.data() + from, min(BATCH_CHUNK, n - from),
+                        points.data(), hit);
+        });
+
+        for (size_t i = 0; i < n; ++i)
+            out.offsets[i + 1] += out.offsets[i];
+
+        // Cleared, then sized with copies of some hit found while
+        // counting (T needs no default constructor); every slot is
+        // overwritten
+        out.hits.clear();
+        if (out.offsets[n] == 0)
+            return;
+        const T* any = nullptr;
+        for (size_t c = 0; c < chunks && !any; ++c)
+            any = firstHits[c];
+        out.hits.assign(out.offsets[n], *any);
+
+        vector<size_t> cursor(out.offsets.begin(), out.offsets.end() - 1);
+        T* hits = out.hits.data();
+        pool.parallelFor(chunks, [&](size_t c) {
+            auto hit = [&cursor, hits](uint32_t id, const T& R) {
+                hits[cursor[id]++] = R;
+            };
+            size_t from = c * BATCH_CHUNK;
+            searchGroup(root, order.data() + from, min(BATCH_CHUNK, n - from),
+                        points.data(), hit);
+        });
     }
 };
 
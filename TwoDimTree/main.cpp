@@ -1,55 +1,124 @@
 #include <iostream>
-#include <fstream>
+#include <vector>
 #include "TwoDimTree.h"
+#include "TwoDimSnapshot.h"
+#include "../common/FastIO.h"
 using namespace std;
 
-int main()
+// queries answered per batch (bounds memory on long replays)
+const size_t QUERY_BLOCK = 1 << 20;
+
+// read up to QUERY_BLOCK queries, fewer if no more input is there yet
+// (a writer may wait for the answers); false once x = -1 or the input
+// ended
+bool readQueries(FastIO::IntReader& in, vector<QueryPoint>& queries)
+{
+    queries.clear();
+    QueryPoint q = {0, 0};
+    while (queries.size() < QUERY_BLOCK) {
+        if (!queries.empty() && !in.buffered())
+            return true;
+        if (!in.next(q.x) || q.x == -1 || !in.next(q.y))
+            return false;
+        queries.push_back(q);
+    }
+    return true;
+}
+
+// print one query with the rectangles found for it
+void printResult(FastIO::TextWriter& out, const QueryPoint& q,
+                 const Rectangle* begin, const Rectangle* end)
+{
+    out << q.x << ' ' << q.y << '\n';
+
+    // print number of found rectangles
+    out << static_cast<size_t>(end - begin) << '\n';
+
+    // print rectangles
+    for (const Rectangle* r = begin; r != end; ++r)
+        out << r->Top << ' ' << r->Left << ' ' << r->Bottom << ' '
+            << r->Right << '\n';
+}
+
+/*
+   Usage: main [snapshot]
+   With a snapshot file that exists, the queries are answered from
+   it directly and rectdb.txt is not read. Otherwise the tree is
+   built from rectdb.txt and, if a snapshot file was named, saved
+   there for the next run.
+ */
+int main(int argc, char* argv[])
 {
+    string snapshotFile = argc > 1 ? argv[1] : "";
+    FastIO::IntReader queryInput;
+    FastIO::TextWriter out;
+    vector<QueryPoint> queries;
+    bool more = true;
+
+    if (!snapshotFile.empty()) {
+        TwoDimSnapshot<Rectangle> snapshot(snapshotFile);
+        if (snapshot) {
+            vector<Rectangle> found;
+            while (more) {
+                more = readQueries(queryInput, queries);
+                for (size_t i = 0; i < queries.size(); ++i) {
+                    found.clear();
+                    snapshot.search(queries[i].x, queries[i].y, found);
+                    printResult(out, queries[i], found.data(),
+                                found.data() + found.size());
+                }
+                if (!queryInput.isRegularFile())
+                    out.flush();    // answer a pipe or terminal now
+            }
+            return 0;
+        }
+    }
+
     // read file
     string filename = "rectdb.txt";
-    ifstream inputFile(filename);
+    FastIO::IntReader inputFile(filename);
 
-    if (inputFile.fail()) {
+    if (!inputFile.isOpen()) {
         cout << "Error: Cannot open the file " << filename << endl;
         return 1;
     }
 
     // set up the tree
-    int top, left, bottom, right;
-    inputFile >> top >> left >> bottom >> right;
+    int top = 0, left = 0, bottom = 0, right = 0;
+    inputFile.next(top);
+    inputFile.next(left);
+    inputFile.next(bottom);
+    inputFile.next(right);
     Rectangle rootExtent(top, left, bottom, right);
 
-    TwoDimTree<Rectangle> tree(rootExtent);
-
     // read rectangles
-    while (inputFile >> top && top != -1) {
-        inputFile >> left >> bottom >> right;
-        tree.insert(Rectangle(top, left, bottom, right));
+    vector<Rectangle> rects;
+    while (inputFile.next(top) && top != -1) {
+        inputFile.next(left);
+        inputFile.next(bottom);
+        inputFile.next(right);
+        rects.push_back(Rectangle(top, left, bottom, right));
     }
 
-    inputFile.close();
+    // build the whole tree at once
+    TwoDimTree<Rectangle> tree(rootExtent, rects);
+    vector<Rectangle>().swap(rects);
 
-    // query cycle until x = -1
-    int x, y;
-    while (cin >> x && x != -1) {
-        cin >> y;
+    if (!snapshotFile.empty() &&
+        !TwoDimSnapshot<Rectangle>::write(tree, snapshotFile))
+        cerr << "Warning: Cannot write the snapshot " << snapshotFile << endl;
 
-        cout << x << " " << y << endl;
+    // answer the queries block by block until x = -1
+    BatchResult<Rectangle> results;
+    ThreadPool pool;    // one per core, kept for every block
+    while (more) {
+        more = readQueries(queryInput, queries);
+        tree.searchBatch(queries, results, pool);
 
-        // create empty result list
-        List<Rectangle> results;
-
-        // search the tree
-        tree.search(x, y, results);
-
-        // print number of found rectangles
-        cout << results.count() << endl;
-
-        // print rectangles
-        for (ListItr<Rectangle> it = results.first(); !it.isPastEnd(); it.advance()) {
-            it.retrieve().print();
-            cout << endl;
-        }
+        for (size_t i = 0; i < queries.size(); ++i)
+            printResult(out, queries[i], results.begin(i), results.end(i));
+        if (!queryInput.isRegularFile())
+            out.flush();    // answer a pipe or terminal now
     }
 
     return 0;
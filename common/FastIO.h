@@ -0,0 +1,333 @@
+#ifndef FASTIO_H
+#define FASTIO_H
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+   FastIO
+   Text input and output for large integer streams (rectangle files,
+   query replays), in place of iostream >> and << endl; shared by
+   the TwoDimTree and Skyline programs:
+
+   - IntReader maps a regular file (stdin too, when redirected from
+     one) or else takes whatever one read() returns, up to a large
+     block, so a pipe or terminal is served as its input arrives.
+     It parses integers by hand, eight digits at a time (SWAR: one
+     64-bit word holds eight characters).
+   - TextWriter collects output in one large buffer and writes it
+     out only when full or on flush(), never once per line.
+ */
+namespace FastIO {
+
+const size_t BLOCK = 1 << 20;   // 1 MB per read/write call
+
+/*
+   IntReader
+   Reads whitespace-separated decimal integers, optionally signed.
+   next(v) stores the next one and returns true, or returns false at
+   the end of input, at anything that is not a number and at a number
+   that does not fit in an int, like `stream >> v` does.
+ */
+class IntReader {
+public:
+    // Standard input.
+    IntReader() : fd(STDIN_FILENO), ownsFd(false) { open(); }
+
+    explicit IntReader(const std::string& path)
+        : fd(::open(path.c_str(), O_RDONLY)), ownsFd(true) { open(); }
+
+    ~IntReader() {
+        if (mapped)
+            ::munmap(mapped, mappedSize);
+        if (ownsFd && fd >= 0)
+            ::close(fd);
+    }
+
+    IntReader(const IntReader&) = delete;
+    IntReader& operator=(const IntReader&) = delete;
+
+    // False if the input could not be opened.
+    bool isOpen() const { return fd >= 0; }
+
+    // True if the input is a regular file (not a pipe or terminal).
+    bool isRegularFile() const { return regular; }
+
+    // True if the next number (or the end of the input) can be had
+    // without waiting for more input to arrive.
+    bool buffered() {
+        while (cur < end && isSpace(*cur))
+            ++cur;
+        return cur < end || mapped || eof;
+    }
+
+    bool next(int& value) {
+        // Skip whitespace, refilling as needed
+        for (;;) {
+            while (cur < end && isSpace(*cur))
+                ++cur;
+            if (cur < end || !fill())
+                break;
+        }
+        if (cur == end)
+            return false;
+
+        // A number may straddle two reads: make sure it is whole
+        // (or the input ends) before parsing it
+        if (!mapped && runsToEnd())
+            keepAndFill();
+
+        bool negative = *cur == '-';
+        const char* p = cur + (negative || *cur == '+');
+        if (p == end || !isDigit(*p))
+            return false;
+
+        // -INT_MIN, or INT_MAX: eight digits stay below either
+        const int64_t limit = negative ? -int64_t(INT_MIN) : INT_MAX;
+
+        int64_t v = 0;
+        if (end - p >= 8) {
+            // Up to eight digits in one go
+            uint64_t word;
+            memcpy(&word, p, 8);
+            unsigned digits = digitRun(word);
+            v = static_cast<int64_t>(parseDigits(word, digits));
+            p += digits;
+        }
+        while (p < end && isDigit(*p)) {
+            v = v * 10 + (*p++ - '0');
+            if (v > limit)
+                return false;
+        }
+
+        cur = p;
+        value = static_cast<int>(negative ? -v : v);
+        return true;
+    }
+
+private:
+    int fd;
+    bool ownsFd;
+    bool regular = false;           // a regular file
+    char* mapped = nullptr;         // whole file, when mapped
+    size_t mappedSize = 0;
+    std::vector<char> buffer;       // read buffer otherwise
+    const char* cur = nullptr;      // unparsed input
+    const char* end = nullptr;
+    bool eof = false;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' ||
+               c == '\v' || c == '\f';
+    }
+
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    /* Number of leading digit characters (0..8) in word, first
+       character in the low byte. A byte b is not a digit when b - '0'
+       is negative or b - '0' + 0x76 reaches 0x80; only bytes above the
+       first non-digit can be disturbed by borrows and carries. */
+    static unsigned digitRun(uint64_t word) {
+        uint64_t v = word - 0x3030303030303030ull;
+        uint64_t bad = (v | (v + 0x7676767676767676ull)) & 0x8080808080808080ull;
+        if (bad == 0)
+            return 8;
+        return static_cast<unsigned>(__builtin_ctzll(bad)) / 8;
+    }
+
+    /* Value of the first n (1..8) digits of word. They are moved to
+       the top, leaving zero bytes as leading zeros, then combined in
+       pairs, quads and halves by three multiplications. */
+    static uint64_t parseDigits(uint64_t word, unsigned n) {
+        if (n == 0)
+            return 0;
+        uint64_t v = (word - 0x3030303030303030ull) << (8 * (8 - n));
+        v = (v & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+        v = (v & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+        return (v & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32;
+    }
+
+    void open() {
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        regular = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (regular && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size),
+                             PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                mapped = static_cast<char*>(p);
+                mappedSize = static_cast<size_t>(st.st_size);
+                cur = mapped;
+                end = mapped + mappedSize;
+                eof = true;
+                return;
+            }
+        }
+        buffer.resize(BLOCK);
+        cur = end = buffer.data();
+    }
+
+    // Replaces the (consumed) buffer with what the next read gives.
+    bool fill() {
+        if (eof)
+            return false;
+        size_t got = readOnce(buffer.data(), buffer.size());
+        cur = buffer.data();
+        end = cur + got;
+        return got > 0;
+    }
+
+    // True if the number at cur reaches the end of the buffer, so
+    // more of it may still be coming.
+    bool runsToEnd() const {
+        const char* p = cur + (*cur == '-' || *cur == '+');
+        while (p < end && isDigit(*p))
+            ++p;
+        return p == end && !eof;
+    }
+
+    // Moves the unparsed rest to the front and reads after it until
+    // the number at cur is complete (or the input ends).
+    void keepAndFill() {
+        size_t rest = static_cast<size_t>(end - cur);
+        memmove(buffer.data(), cur, rest);
+        cur = buffer.data();
+        end = cur + rest;
+        while (runsToEnd() && rest < buffer.size()) {
+            rest += readOnce(buffer.data() + rest, buffer.size() - rest);
+            end = cur + rest;
+        }
+    }
+
+    // One read() (retried if interrupted); 0 at the end of input.
+    size_t readOnce(char* dest, size_t size) {
+        for (;;) {
+            ssize_t n = ::read(fd, dest, size);
+            if (n > 0)
+                return static_cast<size_t>(n);
+            if (n == 0 || errno != EINTR) {
+                eof = true;
+                return 0;
+            }
+        }
+    }
+};
+
+/*
+   TextWriter
+   Buffered output to standard output. The destructor flushes;
+   call flush() to check for errors.
+ */
+class TextWriter {
+public:
+    TextWriter() : fd(STDOUT_FILENO), used(0), error(false), buffer(BLOCK) {}
+
+    ~TextWriter() { flush(); }
+
+    TextWriter(const TextWriter&) = delete;
+    TextWriter& operator=(const TextWriter&) = delete;
+
+    TextWriter& operator<<(char c) {
+        if (used == buffer.size())
+            drain();
+        buffer[used++] = c;
+        return *this;
+    }
+
+    TextWriter& operator<<(const char* s) {
+        write(s, strlen(s));
+        return *this;
+    }
+
+    TextWriter& operator<<(long long v) {
+        char digits[24];
+        char* p = digits + sizeof(digits);
+        unsigned long long u = v < 0 ? 0ull - static_cast<unsigned long long>(v)
+                                     : static_cast<unsigned long long>(v);
+        // Two digits per division
+        while (u >= 100) {
+            unsigned pair = static_cast<unsigned>(u % 100);
+            u /= 100;
+            *--p = PAIRS[2 * pair + 1];
+            *--p = PAIRS[2 * pair];
+        }
+        if (u >= 10) {
+            *--p = PAIRS[2 * u + 1];
+            *--p = PAIRS[2 * u];
+        } else {
+            *--p = static_cast<char>('0' + u);
+        }
+        if (v < 0)
+            *--p = '-';
+        write(p, static_cast<size_t>(digits + sizeof(digits) - p));
+        return *this;
+    }
+
+    TextWriter& operator<<(int v) { return *this << static_cast<long long>(v); }
+
+    TextWriter& operator<<(size_t v) {
+        return *this << static_cast<long long>(v);
+    }
+
+    // Writes out everything buffered. Returns false on a write error.
+    bool flush() {
+        drain();
+        return !error;
+    }
+
+private:
+    static constexpr const char* PAIRS =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    int fd;
+    size_t used;
+    bool error;
+    std::vector<char> buffer;
+
+    void write(const char* s, size_t n) {
+        if (n > buffer.size() - used)
+            drain();
+        if (n > buffer.size()) {
+            writeAll(s, n);
+            return;
+        }
+        memcpy(buffer.data() + used, s, n);
+        used += n;
+    }
+
+    void drain() {
+        writeAll(buffer.data(), used);
+        used = 0;
+    }
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0 && !error) {
+            ssize_t n = ::write(fd, data, size);
+            if (n >= 0) {
+                data += n;
+                size -= static_cast<size_t>(n);
+            } else if (errno != EINTR) {
+                error = true;
+            }
+        }
+    }
+};
+
+} // namespace FastIO
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * ThreadPool class
+ * ----------------
+ * A fixed set of worker threads that run parallel loops.
+ *
+ * parallelFor(count, task) calls task(i) for every i in [0, count)
+ * and returns when all calls have finished. Indices are handed out
+ * one by one through an atomic counter, so uneven tasks (blocks that
+ * compress at different speeds, query chunks of different depth)
+ * still keep every thread busy. The calling thread takes part in the
+ * work as well.
+ *
+ * Used by the LZW programs and by TwoDimTree::searchBatch, whose
+ * callers keep one pool for many batches.
+ */
+class ThreadPool {
+public:
+    /*
+     * Constructor
+     * ------------
+     * Starts threadCount - 1 workers (the caller is the last one).
+     * A count of 0 means one thread per hardware core.
+     */
+    explicit ThreadPool(size_t threadCount = 0)
+        : current(nullptr), generation(0), taskCount(0), nextIndex(0),
+          running(0), stopping(false) {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+
+        for (size_t i = 1; i < threadCount; ++i)
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Number of threads that run tasks, including the caller.
+    size_t size() const { return workers.size() + 1; }
+
+    /*
+     * maxThreads
+     * ----------
+     * Largest thread count worth asking for: a few per core (more
+     * only adds switching), or 64 if the core count is unknown.
+     */
+    static size_t maxThreads() {
+        size_t cores = std::thread::hardware_concurrency();
+        return cores ? 4 * cores : 64;
+    }
+
+    /*
+     * parallelFor
+     * -----------
+     * Runs task(i) for i = 0 .. count-1 across the pool.
+     * Not reentrant: call it from one thread at a time.
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)> &task) {
+        if (count == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &task;
+            taskCount = count;
+            nextIndex.store(0);
+            running = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        runTasks(task, count);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return running == 0; });
+        current = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;   // new loop posted (or stopping)
+    std::condition_variable done;   // a worker finished its share
+
+    const std::function<void(size_t)> *current;
+    size_t generation;              // bumped once per parallelFor
+    size_t taskCount;
+    std::atomic<size_t> nextIndex;  // next index to hand out
+    size_t running;                 // workers still inside the loop
+    bool stopping;
+
+    void runTasks(const std::function<void(size_t)> &task, size_t count) {
+        for (;;) {
+            size_t i = nextIndex.fetch_add(1);
+            if (i >= count)
+                break;
+            task(i);
+        }
+    }
+
+    void workerLoop() {
+        size_t seen = 0;
+        for (;;) {
+            const std::function<void(size_t)> *task;
+            size_t count;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                task = current;
+                count = taskCount;
+            }
+
+            runTasks(*task, count);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --running;
+            }
+            done.notify_one();
+        }
+    }
+};
+
+#endif
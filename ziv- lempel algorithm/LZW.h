@@ -0,0 +1,359 @@
+#ifndef LZW_H
+#define LZW_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "LZWFormat.h"
+#include "StreamIO.h"
+#include "compress-program/LZWEncoder.h"
+#include "decompress-program/LZWDecoder.h"
+
+/*
+ * LZW codec library
+ * -----------------
+ * In-memory interface to the codec used by the compress and
+ * decompress programs, for callers that want to compress data in
+ * their own process. Output is the same container (LZWFormat.h) the
+ * programs read and write.
+ *
+ * Whole buffers:
+ *   LZW::compress(data, size, out)       out: any sink, a vector, or
+ *   LZW::decompress(data, size, out)          a caller buffer
+ *
+ * Streaming:
+ *   LZW::Compressor<Sink>    update(data, size) ... finish()
+ *   LZW::Decompressor<Sink>  update(data, size) ... finish()
+ *
+ * A sink is anything with put(byte), write(data, size), append(size)
+ * and flush(): StreamIO::ByteSink (file), MemorySink (vector) or
+ * BufferSink (fixed caller buffer, no allocation).
+ *
+ * The streaming classes write a single code stream. decompress()
+ * also accepts block-mode input written by compress --blocks and
+ * decodes its blocks one after the other.
+ */
+namespace LZW {
+
+/*
+ * Options
+ * -------
+ * maxBits  : widest code, MIN_CODE_BITS to MAX_CODE_BITS
+ * useClear : reset the dictionary when the ratio drops (FLAG_CLEAR)
+ */
+struct Options {
+    int maxBits;
+    bool useClear;
+
+    Options() : maxBits(16), useClear(true) { }
+};
+
+inline bool validOptions(const Options &options) {
+    return options.maxBits >= LZWFormat::MIN_CODE_BITS &&
+           options.maxBits <= LZWFormat::MAX_CODE_BITS;
+}
+
+/*
+ * Compressor class
+ * ----------------
+ * Streaming compression into a sink. The header is written by the
+ * constructor, update() may be called any number of times and
+ * finish() completes the code stream; check the sink's flush()
+ * afterwards.
+ */
+template <class Sink>
+class Compressor {
+public:
+    explicit Compressor(Sink &out, const Options &options = Options())
+        : valid(validOptions(options)), finished(false), bits(out),
+          encoder(valid ? options.maxBits : LZWFormat::MIN_CODE_BITS,
+                  options.useClear) {
+        if (!valid)
+            return;
+
+        LZWFormat::Header header;
+        header.maxBits = options.maxBits;
+        header.flags = options.useClear ? LZWFormat::FLAG_CLEAR : 0;
+        LZWFormat::writeHeader(out, header);
+    }
+
+    // False if the options were invalid (nothing is written then).
+    explicit operator bool() const { return valid; }
+
+    void update(const unsigned char *data, size_t size) {
+        if (valid && !finished)
+            encoder.update(data, size, bits);
+    }
+
+    void finish() {
+        if (valid && !finished) {
+            encoder.finish(bits);
+            finished = true;
+        }
+    }
+
+private:
+    bool valid;
+    bool finished;
+    LZWFormat::BitWriter<Sink> bits;
+    LZWEncoder encoder;
+};
+
+/*
+ * Decompressor class
+ * ------------------
+ * Streaming decompression of a single-stream container. Input may be
+ * split anywhere, even inside the header or a code. update() and
+ * finish() return false (see lastError) once the input is found to
+ * be invalid.
+ */
+template <class Sink>
+class Decompressor {
+public:
+    explicit Decompressor(Sink &out)
+        : out(out), headerBytes(0), bits(source), error(nullptr) { }
+
+    // Starts after a header the caller has already read.
+    Decompressor(Sink &out, const LZWFormat::Header &header)
+        : out(out), headerBytes(LZWFormat::HEADER_SIZE), bits(source),
+          error(nullptr) {
+        start(header);
+    }
+
+    bool update(const unsigned char *data, size_t size) {
+        if (error)
+            return false;
+
+        // Collect the header first
+        while (headerBytes < LZWFormat::HEADER_SIZE && size > 0) {
+            header[headerBytes++] = *data++;
+            --size;
+
+            if (headerBytes == LZWFormat::HEADER_SIZE && !parseHeader())
+                return false;
+        }
+
+        if (size == 0)
+            return true;
+
+        source.set(data, size);
+        if (!decoder->decode(bits, out)) {
+            error = decoder->lastError();
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false if the input was invalid or ended inside the header.
+    bool finish() {
+        if (!error && headerBytes < LZWFormat::HEADER_SIZE)
+            error = "truncated header";
+        return !error;
+    }
+
+    // Description of the first error, or nullptr.
+    const char *lastError() const { return error; }
+
+private:
+    Sink &out;
+    unsigned char header[LZWFormat::HEADER_SIZE];
+    size_t headerBytes;             // header bytes received so far
+
+    StreamIO::ChunkSource source;
+    LZWFormat::BitReader<StreamIO::ChunkSource> bits;
+    std::unique_ptr<LZWDecoder> decoder;   // created once the header is known
+    const char *error;
+
+    bool parseHeader() {
+        StreamIO::MemorySource in(header, LZWFormat::HEADER_SIZE);
+        LZWFormat::Header h;
+        if (!LZWFormat::readHeader(in, h)) {
+            error = "invalid header";
+            return false;
+        }
+        return start(h);
+    }
+
+    bool start(const LZWFormat::Header &h) {
+        if (h.flags & LZWFormat::FLAG_BLOCKS) {
+            error = "block mode input needs decompress()";
+            return false;
+        }
+        decoder.reset(new LZWDecoder(h));
+        return true;
+    }
+};
+
+/*
+ * compress
+ * --------
+ * Compresses data[0 .. size) into a complete container.
+ * Returns false if the options are invalid or the sink fails
+ * (for a BufferSink: the buffer is too small, see size()).
+ */
+template <class Sink>
+bool compress(const unsigned char *data, size_t size, Sink &out,
+              const Options &options = Options()) {
+    Compressor<Sink> compressor(out, options);
+    if (!compressor)
+        return false;
+
+    compressor.update(data, size);
+    compressor.finish();
+    return out.flush();
+}
+
+// Replaces the contents of out with the compressed data.
+inline bool compress(const unsigned char *data, size_t size,
+                     std::vector<unsigned char> &out,
+                     const Options &options = Options()) {
+    out.clear();
+    StreamIO::MemorySink sink(out);
+    return compress(data, size, sink, options);
+}
+
+/*
+ * Caller-supplied buffer: written is set to the compressed size.
+ * If that is more than capacity, false is returned and the call can
+ * be repeated with a buffer of at least `written` bytes.
+ */
+inline bool compress(const unsigned char *data, size_t size,
+                     unsigned char *dest, size_t capacity, size_t &written,
+                     const Options &options = Options()) {
+    StreamIO::BufferSink sink(dest, capacity);
+    bool ok = compress(data, size, sink, options);
+    written = sink.size();
+    return ok;
+}
+
+/*
+ * CountingSink
+ * ------------
+ * Passes everything on to another sink and counts the bytes, so a
+ * block's decoded size can be checked against its frame.
+ */
+template <class Sink>
+class CountingSink {
+public:
+    explicit CountingSink(Sink &s) : out(s), bytes(0) {}
+
+    void put(unsigned char byte) {
+        out.put(byte);
+        ++bytes;
+    }
+
+    void write(const unsigned char *data, size_t size) {
+        out.write(data, size);
+        bytes += size;
+    }
+
+    unsigned char *append(size_t size) {
+        bytes += size;
+        return out.append(size);
+    }
+
+    bool flush() { return out.flush(); }
+
+    // Bytes passed on so far.
+    uint64_t count() const { return bytes; }
+
+private:
+    Sink &out;
+    uint64_t bytes;
+};
+
+/*
+ * decompress
+ * ----------
+ * Decompresses a complete container (single stream or block mode)
+ * and writes the original data to out. An empty input decodes to
+ * nothing, as in the decompress program. Returns false if the input
+ * is invalid (with a description in *error when error is given) or
+ * the sink fails.
+ */
+template <class Sink>
+bool decompress(const unsigned char *data, size_t size, Sink &out,
+                const char **error = nullptr) {
+    const char *problem = nullptr;
+    LZWFormat::Header header;
+    StreamIO::MemorySource in(data, size);
+
+    if (size == 0) {
+        return out.flush();
+    } else if (!LZWFormat::readHeader(in, header)) {
+        problem = "invalid header";
+    } else if (!(header.flags & LZWFormat::FLAG_BLOCKS)) {
+        LZWFormat::BitReader<StreamIO::MemorySource> bits(in);
+        LZWDecoder decoder(header);
+        if (!decoder.decode(bits, out))
+            problem = decoder.lastError();
+    } else {
+        // Frames follow the header; the index after the end frame is skipped
+        size_t offset = LZWFormat::HEADER_SIZE;
+        for (;;) {
+            if (size - offset < LZWFormat::FRAME_SIZE) {
+                problem = "truncated block frame";
+                break;
+            }
+            uint32_t rawSize = LZWFormat::getU32(data + offset);
+            uint32_t packedSize = LZWFormat::getU32(data + offset + 4);
+            offset += LZWFormat::FRAME_SIZE;
+
+            if (rawSize == 0)
+                break;
+            if (size - offset < packedSize) {
+                problem = "truncated block";
+                break;
+            }
+
+            StreamIO::MemorySource block(data + offset, packedSize);
+            LZWFormat::BitReader<StreamIO::MemorySource> bits(block);
+            LZWDecoder decoder(header);
+            CountingSink<Sink> counted(out);
+            if (!decoder.decode(bits, counted)) {
+                problem = decoder.lastError();
+                break;
+            }
+            if (counted.count() != rawSize) {
+                problem = "block size mismatch";
+                break;
+            }
+            offset += packedSize;
+        }
+    }
+
+    if (problem) {
+        if (error)
+            *error = problem;
+        return false;
+    }
+    return out.flush();
+}
+
+// Replaces the contents of out with the decompressed data.
+inline bool decompress(const unsigned char *data, size_t size,
+                       std::vector<unsigned char> &out,
+                       const char **error = nullptr) {
+    out.clear();
+    StreamIO::MemorySink sink(out);
+    return decompress(data, size, sink, error);
+}
+
+/*
+ * Caller-supplied buffer: written is set to the decompressed size.
+ * If that is more than capacity, false is returned and the call can
+ * be repeated with a buffer of at least `written` bytes.
+ */
+inline bool decompress(const unsigned char *data, size_t size,
+                       unsigned char *dest, size_t capacity, size_t &written,
+                       const char **error = nullptr) {
+    StreamIO::BufferSink sink(dest, capacity);
+    bool ok = decompress(data, size, sink, error);
+    written = sink.size();
+    return ok;
+}
+
+} // namespace LZW
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef LZWFORMAT_H
+#define LZWFORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "StreamIO.h"
+
+/*
+ * LZW container format
+ * --------------------
+ * Shared by the compress and decompress programs so both sides
+ * agree on the header layout and on how codes are packed.
+ *
+ * Header (8 bytes):
+ *   byte 0-1 : magic 'L' 'Z'
+ *   byte 2   : format version
+ *   byte 3   : maximum code width in bits
+ *   byte 4   : flags (FLAG_*)
+ *   byte 5-7 : reserved, zero
+ *
+ * Code stream:
+ *   Codes packed LSB-first into bytes. The first code is written
+ *   with MIN_CODE_BITS bits; the width grows by one bit as soon as
+ *   the largest code that may appear next no longer fits. The last
+ *   byte is padded with zero bits (always fewer than MIN_CODE_BITS).
+ *
+ *   With FLAG_CLEAR, code 256 is CLEAR_CODE and new entries start at
+ *   257. The compressor writes CLEAR_CODE (at the current width) when
+ *   the dictionary is full and the compression ratio has dropped;
+ *   both sides then empty their dictionaries, go back to
+ *   MIN_CODE_BITS and continue as if the stream had just started.
+ *
+ * Body:
+ *   Without FLAG_BLOCKS the body is one code stream.
+ *   With FLAG_BLOCKS the input was split into independent blocks,
+ *   each compressed with a fresh dictionary. Every block is framed
+ *   as [u32 raw size][u32 packed size][code stream], integers little
+ *   endian, and a frame with raw size 0 ends the body.
+ *
+ * Index (FLAG_INDEX, block mode only):
+ *   After the end frame comes one u64 file offset per block (where
+ *   its frame starts), then a 20-byte trailer at the very end:
+ *     [u64 index offset][u32 block count][u32 block size]['L''Z''I''X']
+ *   Every block except the last holds exactly block size raw bytes,
+ *   so the blocks covering a byte range are found by division and
+ *   only their index entries and frames need to be read.
+ */
+namespace LZWFormat {
+
+const unsigned char MAGIC_0 = 'L';
+const unsigned char MAGIC_1 = 'Z';
+const unsigned char VERSION = 2;
+const size_t HEADER_SIZE = 8;
+const size_t FRAME_SIZE = 8;
+const size_t INDEX_ENTRY_SIZE = 8;
+const size_t TRAILER_SIZE = 20;
+
+const unsigned char FLAG_BLOCKS = 1;   // body is a sequence of frames
+const unsigned char FLAG_CLEAR = 2;    // code 256 resets the dictionary
+const unsigned char FLAG_INDEX = 4;    // block offsets stored at the end
+const unsigned char KNOWN_FLAGS = FLAG_BLOCKS | FLAG_CLEAR | FLAG_INDEX;
+
+const int MIN_CODE_BITS = 9;   // enough for the 256 literals + first entry
+const int MAX_CODE_BITS = 20;  // widest code the format accepts
+
+const uint32_t CLEAR_CODE = 256;
+
+/*
+ * firstCode
+ * ---------
+ * First code assigned to a multi-byte string: 256, or 257 when
+ * code 256 is reserved for CLEAR_CODE.
+ */
+inline uint32_t firstCode(unsigned char flags) {
+    return (flags & FLAG_CLEAR) ? CLEAR_CODE + 1 : CLEAR_CODE;
+}
+
+/*
+ * Header
+ * ------
+ * Decoded form of the container header.
+ */
+struct Header {
+    int maxBits;
+    unsigned char flags;
+};
+
+// Little-endian 32-bit fields used by the header and block frames.
+inline void putU32(unsigned char *dest, uint32_t value) {
+    dest[0] = static_cast<unsigned char>(value);
+    dest[1] = static_cast<unsigned char>(value >> 8);
+    dest[2] = static_cast<unsigned char>(value >> 16);
+    dest[3] = static_cast<unsigned char>(value >> 24);
+}
+
+inline uint32_t getU32(const unsigned char *src) {
+    return static_cast<uint32_t>(src[0]) |
+           static_cast<uint32_t>(src[1]) << 8 |
+           static_cast<uint32_t>(src[2]) << 16 |
+           static_cast<uint32_t>(src[3]) << 24;
+}
+
+inline void putU64(unsigned char *dest, uint64_t value) {
+    putU32(dest, static_cast<uint32_t>(value));
+    putU32(dest + 4, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint64_t getU64(const unsigned char *src) {
+    return static_cast<uint64_t>(getU32(src)) |
+           static_cast<uint64_t>(getU32(src + 4)) << 32;
+}
+
+/*
+ * writeHeader / readHeader
+ * ------------------------
+ * Writes or validates the container header.
+ * readHeader returns false if the magic, version, width or flags
+ * are invalid.
+ */
+template <class Sink>
+void writeHeader(Sink &out, const Header &h) {
+    unsigned char header[HEADER_SIZE] = {
+        MAGIC_0, MAGIC_1, VERSION, static_cast<unsigned char>(h.maxBits),
+        h.flags, 0, 0, 0
+    };
+    out.write(header, HEADER_SIZE);
+}
+
+template <class Source>
+bool readHeader(Source &in, Header &h) {
+    unsigned char header[HEADER_SIZE];
+    if (in.read(header, HEADER_SIZE) != HEADER_SIZE)
+        return false;
+
+    if (header[0] != MAGIC_0 || header[1] != MAGIC_1 || header[2] != VERSION)
+        return false;
+
+    h.maxBits = header[3];
+    h.flags = header[4];
+    return h.maxBits >= MIN_CODE_BITS && h.maxBits <= MAX_CODE_BITS &&
+           (h.flags & ~KNOWN_FLAGS) == 0;
+}
+
+/*
+ * writeFrame / readFrame
+ * ----------------------
+ * Block frame header: raw (uncompressed) size and packed size.
+ * readFrame returns false if the input ends inside the frame header.
+ */
+template <class Sink>
+void writeFrame(Sink &out, uint32_t rawSize, uint32_t packedSize) {
+    unsigned char frame[FRAME_SIZE];
+    putU32(frame, rawSize);
+    putU32(frame + 4, packedSize);
+    out.write(frame, FRAME_SIZE);
+}
+
+template <class Source>
+bool readFrame(Source &in, uint32_t &rawSize, uint32_t &packedSize) {
+    unsigned char frame[FRAME_SIZE];
+    if (in.read(frame, FRAME_SIZE) != FRAME_SIZE)
+        return false;
+    rawSize = getU32(frame);
+    packedSize = getU32(frame + 4);
+    return true;
+}
+
+/*
+ * Trailer
+ * -------
+ * Decoded form of the index trailer.
+ */
+struct Trailer {
+    uint64_t indexOffset;   // file offset of the first index entry
+    uint32_t blockCount;
+    uint32_t blockSize;     // raw size of every block but the last
+};
+
+/*
+ * writeIndex
+ * ----------
+ * Writes the index entries (frame offsets) and the trailer.
+ */
+template <class Sink>
+void writeIndex(Sink &out, const std::vector<uint64_t> &frameOffsets,
+                uint64_t indexOffset, uint32_t blockSize) {
+    unsigned char entry[INDEX_ENTRY_SIZE];
+    for (size_t i = 0; i < frameOffsets.size(); ++i) {
+        putU64(entry, frameOffsets[i]);
+        out.write(entry, INDEX_ENTRY_SIZE);
+    }
+
+    unsigned char trailer[TRAILER_SIZE];
+    putU64(trailer, indexOffset);
+    putU32(trailer + 8, static_cast<uint32_t>(frameOffsets.size()));
+    putU32(trailer + 12, blockSize);
+    trailer[16] = 'L';
+    trailer[17] = 'Z';
+    trailer[18] = 'I';
+    trailer[19] = 'X';
+    out.write(trailer, TRAILER_SIZE);
+}
+
+/*
+ * readTrailer
+ * -----------
+ * Reads the trailer from the end of a seekable source.
+ * Returns false if it is missing or inconsistent with the file size.
+ */
+template <class Source>
+bool readTrailer(Source &in, Trailer &t) {
+    uint64_t fileSize;
+    unsigned char trailer[TRAILER_SIZE];
+    if (!in.size(fileSize) || fileSize < HEADER_SIZE + TRAILER_SIZE ||
+        !in.readAt(fileSize - TRAILER_SIZE, trailer, TRAILER_SIZE))
+        return false;
+
+    if (trailer[16] != 'L' || trailer[17] != 'Z' ||
+        trailer[18] != 'I' || trailer[19] != 'X')
+        return false;
+
+    t.indexOffset = getU64(trailer);
+    t.blockCount = getU32(trailer + 8);
+    t.blockSize = getU32(trailer + 12);
+
+    uint64_t indexBytes = static_cast<uint64_t>(t.blockCount) * INDEX_ENTRY_SIZE;
+    return t.blockSize > 0 && t.indexOffset >= HEADER_SIZE &&
+           t.indexOffset + indexBytes + TRAILER_SIZE == fileSize;
+}
+
+/*
+ * growWidth
+ * ---------
+ * Widens codeWidth until maxCode fits, without exceeding maxBits.
+ * Both sides call this with the largest code that can appear next,
+ * which keeps the encoder and decoder widths in lockstep.
+ */
+inline void growWidth(int &codeWidth, uint32_t maxCode, int maxBits) {
+    while (codeWidth < maxBits && maxCode >= (1u << codeWidth))
+        ++codeWidth;
+}
+
+/*
+ * BitWriter
+ * ---------
+ * Packs variable-width codes into a 64-bit accumulator and hands
+ * whole bytes to a sink (StreamIO::ByteSink or MemorySink).
+ */
+template <class Sink>
+class BitWriter {
+public:
+    explicit BitWriter(Sink &o)
+        : out(o), acc(0), accBits(0) { }
+
+    ~BitWriter() {
+        flush();
+    }
+
+    // Appends the low `width` bits of code (width <= 32).
+    void write(uint32_t code, int width) {
+        acc |= static_cast<uint64_t>(code) << accBits;
+        accBits += width;
+
+        while (accBits >= 8) {
+            out.put(static_cast<unsigned char>(acc));
+            acc >>= 8;
+            accBits -= 8;
+        }
+    }
+
+    // Writes the pending partial byte, zero padded.
+    void flush() {
+        if (accBits > 0) {
+            out.put(static_cast<unsigned char>(acc));
+            acc = 0;
+            accBits = 0;
+        }
+    }
+
+private:
+    Sink &out;
+    uint64_t acc;     // pending bits, LSB first
+    int accBits;      // number of valid bits in acc
+};
+
+/*
+ * BitReader
+ * ---------
+ * Reads variable-width codes written by BitWriter.
+ * Bytes are taken straight from the source chunks (ByteSource or
+ * MemorySource, no copy when the input is in memory or mapped)
+ * into a 64-bit accumulator.
+ */
+template <class Source>
+class BitReader {
+public:
+    explicit BitReader(Source &i)
+        : in(i), pos(nullptr), end(nullptr), acc(0), accBits(0) { }
+
+    /*
+     * read
+     * ----
+     * Stores the next `width`-bit code in code.
+     * Returns false when fewer than `width` bits are left
+     * (the zero padding at the end of the stream).
+     */
+    bool read(uint32_t &code, int width) {
+        while (accBits < width) {
+            if (pos == end && !refill())
+                return false;
+            acc |= static_cast<uint64_t>(*pos++) << accBits;
+            accBits += 8;
+        }
+
+        code = static_cast<uint32_t>(acc & ((1ull << width) - 1));
+        acc >>= width;
+        accBits -= width;
+        return true;
+    }
+
+private:
+    Source &in;
+    const unsigned char *pos;   // next unread byte of current chunk
+    const unsigned char *end;   // end of current chunk
+    uint64_t acc;               // pending bits, LSB first
+    int accBits;                // number of valid bits in acc
+
+    bool refill() {
+        size_t size;
+        if (!in.next(pos, size))
+            return false;
+        end = pos + size;
+        return true;
+    }
+};
+
+} // namespace LZWFormat
+
+#endif
@@ -0,0 +1,482 @@
+#ifndef STREAMIO_H
+#define STREAMIO_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Streaming I/O layer
+ * -------------------
+ * Block-buffered byte input and output on top of file descriptors.
+ * Both programs use it so that data moves in large chunks instead of
+ * one stream call per byte.
+ *
+ * A path of "-" means stdin (ByteSource) or stdout (ByteSink).
+ */
+namespace StreamIO {
+
+const size_t DEFAULT_BLOCK = 1 << 20; // 1 MB per read/write call
+
+/*
+ * ByteSource
+ * ----------
+ * Hands out the input as a sequence of contiguous chunks.
+ *
+ * With useMmap, a regular file is mapped and returned as one chunk
+ * (no copy at all). Otherwise, or if mapping is not possible
+ * (pipes, stdin), the input is read block by block into a buffer.
+ */
+class ByteSource {
+public:
+    explicit ByteSource(const std::string &path, bool useMmap = false,
+                        size_t blockSize = DEFAULT_BLOCK)
+        : fd(-1), ownsFd(false), mapped(nullptr), mappedSize(0),
+          mapDone(false), error(false), cur(nullptr), curEnd(nullptr) {
+        if (path == "-") {
+            fd = STDIN_FILENO;
+        } else {
+            fd = ::open(path.c_str(), O_RDONLY);
+            ownsFd = true;
+        }
+
+        if (fd < 0) {
+            error = true;
+            return;
+        }
+
+        if (useMmap)
+            tryMap();
+        if (!mapped)
+            buffer.resize(blockSize);
+    }
+
+    ~ByteSource() {
+        if (mapped)
+            ::munmap(mapped, mappedSize);
+        if (ownsFd && fd >= 0)
+            ::close(fd);
+    }
+
+    ByteSource(const ByteSource &) = delete;
+    ByteSource &operator=(const ByteSource &) = delete;
+
+    // True if the input was opened and no read error happened.
+    explicit operator bool() const { return !error; }
+
+    /*
+     * next
+     * ----
+     * Points data/size at the next chunk of unconsumed input and
+     * marks it consumed. Returns false at end of input (or on a read
+     * error). The chunk stays valid until the next call.
+     */
+    bool next(const unsigned char *&data, size_t &size) {
+        if (cur == curEnd && !fetch())
+            return false;
+        data = cur;
+        size = static_cast<size_t>(curEnd - cur);
+        cur = curEnd;
+        return true;
+    }
+
+    // True once every byte has been consumed.
+    bool atEnd() {
+        return cur == curEnd && !fetch();
+    }
+
+    /*
+     * size / readAt
+     * -------------
+     * Random access for seekable inputs (regular files only).
+     * size stores the total file size; readAt copies exactly size
+     * bytes starting at offset. Both return false if the input is
+     * not seekable or the range is not available. They do not move
+     * the streaming position used by next() and read().
+     */
+    bool size(uint64_t &bytes) const {
+        if (mapped) {
+            bytes = mappedSize;
+            return true;
+        }
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+            return false;
+        bytes = static_cast<uint64_t>(st.st_size);
+        return true;
+    }
+
+    bool readAt(uint64_t offset, unsigned char *dest, size_t size) {
+        if (mapped) {
+            if (offset > mappedSize || size > mappedSize - offset)
+                return false;
+            std::memcpy(dest, static_cast<const unsigned char *>(mapped) + offset,
+                        size);
+            return true;
+        }
+
+        size_t total = 0;
+        while (total < size) {
+            ssize_t n = ::pread(fd, dest + total, size - total,
+                                static_cast<off_t>(offset + total));
+            if (n > 0)
+                total += static_cast<size_t>(n);
+            else if (n == 0 || errno != EINTR)
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * read
+     * ----
+     * Copies up to size bytes into dest (for headers and other
+     * small fixed-size fields). Returns the number of bytes copied,
+     * which is less than size only at the end of input.
+     */
+    size_t read(unsigned char *dest, size_t size) {
+        size_t total = 0;
+        while (total < size) {
+            if (cur == curEnd && !fetch())
+                break;
+            size_t n = static_cast<size_t>(curEnd - cur);
+            if (n > size - total)
+                n = size - total;
+            std::memcpy(dest + total, cur, n);
+            cur += n;
+            total += n;
+        }
+        return total;
+    }
+
+private:
+    int fd;
+    bool ownsFd;
+    void *mapped;                       // mmap base, or nullptr
+    size_t mappedSize;
+    bool mapDone;                       // mapped chunk already handed out
+    bool error;
+    std::vector<unsigned char> buffer;  // read buffer when not mapped
+    const unsigned char *cur;           // unconsumed part of current chunk
+    const unsigned char *curEnd;
+
+    // Loads the next chunk into [cur, curEnd). Returns false at the end.
+    bool fetch() {
+        if (mapped) {
+            if (mapDone)
+                return false;
+            mapDone = true;
+            cur = static_cast<const unsigned char *>(mapped);
+            curEnd = cur + mappedSize;
+            return true;
+        }
+
+        size_t got = fill(buffer.data(), buffer.size());
+        cur = buffer.data();
+        curEnd = cur + got;
+        return got > 0;
+    }
+
+    void tryMap() {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+            return;
+
+        void *p = ::mmap(nullptr, static_cast<size_t>(st.st_size),
+                         PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+            return;
+
+        ::madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        mapped = p;
+        mappedSize = static_cast<size_t>(st.st_size);
+    }
+
+    size_t fill(unsigned char *dest, size_t size) {
+        size_t total = 0;
+        while (total < size && !error) {
+            ssize_t n = ::read(fd, dest + total, size - total);
+            if (n > 0) {
+                total += static_cast<size_t>(n);
+            } else if (n == 0) {
+                break;
+            } else if (errno != EINTR) {
+                error = true;
+            }
+        }
+        return total;
+    }
+};
+
+/*
+ * ByteSink
+ * --------
+ * Collects output in a large buffer and writes it out in blocks.
+ * Call flush() at the end and check the result; the destructor
+ * flushes too but cannot report errors.
+ */
+class ByteSink {
+public:
+    explicit ByteSink(const std::string &path,
+                      size_t blockSize = DEFAULT_BLOCK)
+        : fd(-1), ownsFd(false), error(false), used(0), buffer(blockSize) {
+        if (path == "-") {
+            fd = STDOUT_FILENO;
+        } else {
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            ownsFd = true;
+        }
+
+        if (fd < 0)
+            error = true;
+    }
+
+    ~ByteSink() {
+        flush();
+        if (ownsFd && fd >= 0)
+            ::close(fd);
+    }
+
+    ByteSink(const ByteSink &) = delete;
+    ByteSink &operator=(const ByteSink &) = delete;
+
+    // True if the output was opened and every write succeeded so far.
+    explicit operator bool() const { return !error; }
+
+    void put(unsigned char byte) {
+        if (used == buffer.size())
+            drain();
+        buffer[used++] = byte;
+    }
+
+    void write(const unsigned char *data, size_t size) {
+        // Large writes bypass the buffer once it has been emptied.
+        if (size >= buffer.size() - used) {
+            drain();
+            if (size >= buffer.size()) {
+                writeAll(data, size);
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, data, size);
+        used += size;
+    }
+
+    /*
+     * append
+     * ------
+     * Reserves size bytes at the end of the buffer and returns a
+     * pointer to them, so callers can build output in place (in any
+     * order). The bytes count as written; they must be filled before
+     * the next call on this sink.
+     */
+    unsigned char *append(size_t size) {
+        if (size > buffer.size() - used) {
+            drain();
+            if (size > buffer.size())
+                buffer.resize(size);
+        }
+        unsigned char *dest = buffer.data() + used;
+        used += size;
+        return dest;
+    }
+
+    // Writes out everything buffered. Returns false on error.
+    bool flush() {
+        drain();
+        return !error;
+    }
+
+private:
+    int fd;
+    bool ownsFd;
+    bool error;
+    size_t used;                        // bytes pending in buffer
+    std::vector<unsigned char> buffer;
+
+    void drain() {
+        writeAll(buffer.data(), used);
+        used = 0;
+    }
+
+    void writeAll(const unsigned char *data, size_t size) {
+        while (size > 0 && !error) {
+            ssize_t n = ::write(fd, data, size);
+            if (n >= 0) {
+                data += n;
+                size -= static_cast<size_t>(n);
+            } else if (errno != EINTR) {
+                error = true;
+            }
+        }
+    }
+};
+
+/*
+ * MemorySource
+ * ------------
+ * ByteSource interface over a buffer that is already in memory
+ * (one block of a framed stream, for example).
+ */
+class MemorySource {
+public:
+    MemorySource(const unsigned char *data, size_t size)
+        : cur(data), curEnd(data + size) { }
+
+    explicit operator bool() const { return true; }
+
+    bool next(const unsigned char *&data, size_t &size) {
+        if (cur == curEnd)
+            return false;
+        data = cur;
+        size = static_cast<size_t>(curEnd - cur);
+        cur = curEnd;
+        return true;
+    }
+
+    bool atEnd() const { return cur == curEnd; }
+
+    size_t read(unsigned char *dest, size_t size) {
+        size_t n = static_cast<size_t>(curEnd - cur);
+        if (n > size)
+            n = size;
+        std::memcpy(dest, cur, n);
+        cur += n;
+        return n;
+    }
+
+private:
+    const unsigned char *cur;     // unconsumed input
+    const unsigned char *curEnd;
+};
+
+/*
+ * MemorySink
+ * ----------
+ * ByteSink interface that appends to a caller-owned vector.
+ */
+class MemorySink {
+public:
+    explicit MemorySink(std::vector<unsigned char> &target) : buffer(target) { }
+
+    explicit operator bool() const { return true; }
+
+    void put(unsigned char byte) { buffer.push_back(byte); }
+
+    void write(const unsigned char *data, size_t size) {
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
+    unsigned char *append(size_t size) {
+        size_t used = buffer.size();
+        buffer.resize(used + size);
+        return buffer.data() + used;
+    }
+
+    bool flush() { return true; }
+
+private:
+    std::vector<unsigned char> &buffer;
+};
+
+/*
+ * BufferSink
+ * ----------
+ * ByteSink interface over a fixed caller-supplied buffer.
+ *
+ * Nothing is allocated while the output fits. Once it does not,
+ * the sink keeps counting bytes (size() then tells how large the
+ * buffer needs to be) and flush() returns false; the buffer
+ * contents are unspecified after an overflow.
+ */
+class BufferSink {
+public:
+    BufferSink(unsigned char *dest, size_t capacity)
+        : buffer(dest), capacity(capacity), used(0) { }
+
+    // True while everything written so far fits in the buffer.
+    explicit operator bool() const { return used <= capacity; }
+
+    void put(unsigned char byte) {
+        if (used < capacity)
+            buffer[used] = byte;
+        ++used;
+    }
+
+    void write(const unsigned char *data, size_t size) {
+        if (fits(size))
+            std::memcpy(buffer + used, data, size);
+        used += size;
+    }
+
+    // Past the end of the buffer, the bytes go to a scratch area.
+    unsigned char *append(size_t size) {
+        unsigned char *dest;
+        if (fits(size)) {
+            dest = buffer + used;
+        } else {
+            if (spill.size() < size)
+                spill.resize(size);
+            dest = spill.data();
+        }
+        used += size;
+        return dest;
+    }
+
+    // Bytes written so far, including any that did not fit.
+    size_t size() const { return used; }
+
+    bool flush() { return used <= capacity; }
+
+private:
+    unsigned char *buffer;
+    size_t capacity;
+    size_t used;
+    std::vector<unsigned char> spill;   // target of append() after overflow
+
+    bool fits(size_t size) const {
+        return used <= capacity && size <= capacity - used;
+    }
+};
+
+/*
+ * ChunkSource
+ * -----------
+ * ByteSource interface for pushed input: set() hands it one chunk,
+ * which next() returns once. A BitReader on top of it keeps the bits
+ * of an unfinished code until the following chunk arrives.
+ */
+class ChunkSource {
+public:
+    ChunkSource() : chunk(nullptr), chunkSize(0) { }
+
+    void set(const unsigned char *data, size_t size) {
+        chunk = data;
+        chunkSize = size;
+    }
+
+    bool next(const unsigned char *&data, size_t &size) {
+        if (chunkSize == 0)
+            return false;
+        data = chunk;
+        size = chunkSize;
+        chunkSize = 0;
+        return true;
+    }
+
+private:
+    const unsigned char *chunk;
+    size_t chunkSize;
+};
+
+} // namespace StreamIO
+
+#endif
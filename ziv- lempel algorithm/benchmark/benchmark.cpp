@@ -0,0 +1,416 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+
+#include <dirent.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../LZW.h"
+#include "../compress-program/HashTable.h"
+
+using namespace std;
+
+/*
+ * LZW benchmark
+ * -------------
+ * Runs the LZW codec library (LZW.h) over generated corpora, plus every file of a local Silesia corpus
+ * if one is found, and reports for each:
+ *
+ *   ratio      : original size / compressed size
+ *   comp/dec   : throughput in MB/s of original data (best of N runs)
+ *   rss        : peak resident memory added by one run, in KB
+ *   allocs/MB  : heap allocations per MB of original data
+ *
+ * Every measurement runs in a forked child, so peak RSS and the
+ * allocation counter belong to that run alone. A short HashTable
+ * section follows, timing string inserts and lookups.
+ *
+ * Usage: benchmark [--size=MB] [--bits=N] [--no-clear] [--repeat=N]
+ *                  [--silesia=DIR]
+ */
+
+/*
+ * Allocation counter
+ * ------------------
+ * Global operator new is replaced to count heap allocations.
+ */
+static size_t allocCount = 0;
+
+void *operator new(size_t size) {
+    ++allocCount;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+/*
+ * Corpus
+ * ------
+ * A named input buffer.
+ */
+struct Corpus {
+    string name;
+    vector<unsigned char> data;
+};
+
+/*
+ * Measurement
+ * -----------
+ * What a child process reports back through its pipe.
+ */
+struct Measurement {
+    double seconds;     // best run
+    long rssKB;         // peak RSS growth during the runs
+    size_t allocs;      // allocations in one run
+    bool ok;            // output matched the expected data
+};
+
+/* ----------------------- corpus generators ----------------------- */
+
+// Uniformly random bytes: incompressible, worst case for the ratio.
+Corpus makeRandom(size_t size) {
+    Corpus c = { "random", vector<unsigned char>(size) };
+    mt19937_64 rng(1);
+    for (size_t i = 0; i < size; ++i)
+        c.data[i] = static_cast<unsigned char>(rng());
+    return c;
+}
+
+// Service log lines: fixed structure, slowly changing fields.
+Corpus makeLogs(size_t size) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "WARN", "ERROR" };
+    static const char *paths[] = {
+        "/api/v1/items", "/api/v1/users", "/api/v1/orders",
+        "/health", "/api/v2/search", "/static/app.js"
+    };
+    static const int statuses[] = { 200, 200, 200, 201, 304, 404, 500 };
+
+    Corpus c = { "logs", vector<unsigned char>() };
+    c.data.reserve(size + 256);
+    mt19937 rng(2);
+    char line[256];
+
+    for (unsigned long i = 0; c.data.size() < size; ++i) {
+        int n = snprintf(line, sizeof(line),
+                         "2026-10-17T%02lu:%02lu:%02lu.%03lu %s request id=%lu "
+                         "path=%s status=%d latency_ms=%u\n",
+                         (i / 3600000) % 24, (i / 60000) % 60, (i / 1000) % 60,
+                         i % 1000, levels[rng() % 5], 100000 + i,
+                         paths[rng() % 6], statuses[rng() % 7],
+                         static_cast<unsigned>(rng() % 900));
+        c.data.insert(c.data.end(), line, line + n);
+    }
+    c.data.resize(size);
+    return c;
+}
+
+// English-like text: Zipf-distributed words, sentences, paragraphs.
+Corpus makeText(size_t size) {
+    static const char *words[] = {
+        "the", "of", "and", "to", "a", "in", "is", "that", "for", "it",
+        "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+        "or", "his", "from", "at", "which", "but", "have", "an", "had",
+        "they", "you", "were", "their", "one", "all", "we", "can", "her",
+        "has", "there", "been", "if", "more", "when", "will", "would",
+        "who", "so", "no", "data", "structure", "tree", "table", "string",
+        "dictionary", "compression", "algorithm", "memory", "search",
+        "rectangle", "queue", "heap", "priority", "node", "value", "key"
+    };
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+    Corpus c = { "text", vector<unsigned char>() };
+    c.data.reserve(size + 64);
+    mt19937 rng(3);
+
+    // Zipf weights 1/(rank+1)
+    vector<double> weights(wordCount);
+    for (size_t i = 0; i < wordCount; ++i)
+        weights[i] = 1.0 / (i + 1);
+    discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+    bool capital = true;
+    while (c.data.size() < size) {
+        string w = words[pick(rng)];
+        if (capital)
+            w[0] = static_cast<char>(toupper(w[0]));
+        capital = false;
+        c.data.insert(c.data.end(), w.begin(), w.end());
+
+        unsigned r = rng() % 100;
+        if (r < 8) {
+            c.data.push_back('.');
+            capital = true;
+            c.data.push_back(rng() % 8 == 0 ? '\n' : ' ');
+        } else if (r < 14) {
+            c.data.push_back(',');
+            c.data.push_back(' ');
+        } else {
+            c.data.push_back(' ');
+        }
+    }
+    c.data.resize(size);
+    return c;
+}
+
+// Binary records: increasing ids and timestamps, small enums, floats.
+Corpus makeBinary(size_t size) {
+    Corpus c = { "binary", vector<unsigned char>() };
+    c.data.reserve(size + 32);
+    mt19937 rng(4);
+    uint64_t timestamp = 1700000000000ull;
+
+    for (uint32_t id = 0; c.data.size() < size; ++id) {
+        unsigned char record[24];
+        uint16_t type = static_cast<uint16_t>(rng() % 12);
+        float value = static_cast<float>(rng() % 10000) / 100.0f;
+        timestamp += rng() % 50;
+
+        memcpy(record, &id, 4);
+        memcpy(record + 4, &type, 2);
+        record[6] = record[7] = 0;
+        memcpy(record + 8, &value, 4);
+        memset(record + 12, 0, 4);
+        memcpy(record + 16, &timestamp, 8);
+        c.data.insert(c.data.end(), record, record + sizeof(record));
+    }
+    c.data.resize(size);
+    return c;
+}
+
+// Every regular file of dir (e.g. the Silesia corpus), if it exists.
+vector<Corpus> loadDirectory(const string &dir) {
+    vector<Corpus> result;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return result;
+
+    while (dirent *e = readdir(d)) {
+        if (e->d_name[0] == '.')
+            continue;
+
+        string path = dir + "/" + e->d_name;
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+            continue;
+
+        Corpus c = { string("silesia/") + e->d_name, vector<unsigned char>() };
+        unsigned char buf[1 << 16];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            c.data.insert(c.data.end(), buf, buf + n);
+        fclose(f);
+
+        if (!c.data.empty())
+            result.push_back(c);
+    }
+    closedir(d);
+    return result;
+}
+
+/* -------------------------- measurement -------------------------- */
+
+// Current or peak ("VmRSS" / "VmHWM") resident size in KB.
+long statusKB(const char *field) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return 0;
+
+    char line[256];
+    long value = 0;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            value = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+/*
+ * measure
+ * -------
+ * Runs job() `repeat` times in a forked child. job returns false if
+ * its output was wrong. The child sends back the best time, the
+ * allocations of the first run and its peak RSS growth.
+ */
+template <class Job>
+Measurement measure(int repeat, Job job) {
+    Measurement m = { 0, 0, 0, false };
+    int fds[2];
+    if (pipe(fds) != 0)
+        return m;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        long baseKB = statusKB("VmRSS");
+
+        Measurement r = { 1e30, 0, 0, true };
+        for (int i = 0; i < repeat; ++i) {
+            size_t before = allocCount;
+            auto start = chrono::steady_clock::now();
+            bool ok = job();
+            double s = chrono::duration<double>(
+                chrono::steady_clock::now() - start).count();
+
+            if (i == 0)
+                r.allocs = allocCount - before;
+            if (s < r.seconds)
+                r.seconds = s;
+            r.ok = r.ok && ok;
+        }
+        r.rssKB = statusKB("VmHWM") - baseKB;
+
+        ssize_t n = write(fds[1], &r, sizeof(r));
+        _exit(n == static_cast<ssize_t>(sizeof(r)) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &m, sizeof(m)) != static_cast<ssize_t>(sizeof(m)))
+            m.ok = false;
+        waitpid(pid, nullptr, 0);
+    }
+    close(fds[0]);
+    return m;
+}
+
+/*
+ * benchCorpus
+ * -----------
+ * Compresses once to get the packed data, then measures compression
+ * and decompression separately and prints one table row.
+ */
+void benchCorpus(const Corpus &c, int maxBits, bool useClear, int repeat) {
+    LZW::Options options;
+    options.maxBits = maxBits;
+    options.useClear = useClear;
+
+    vector<unsigned char> packed;
+    LZW::compress(c.data.data(), c.data.size(), packed, options);
+
+    Measurement comp = measure(repeat, [&] {
+        vector<unsigned char> out(packed.size());
+        size_t written;
+        return LZW::compress(c.data.data(), c.data.size(), out.data(),
+                             out.size(), written, options) && out == packed;
+    });
+
+    Measurement dec = measure(repeat, [&] {
+        vector<unsigned char> raw(c.data.size());
+        size_t written;
+        return LZW::decompress(packed.data(), packed.size(), raw.data(),
+                               raw.size(), written) && raw == c.data;
+    });
+
+    double mb = c.data.size() / 1048576.0;
+    printf("%-22s %9.2f %7.3f %9.1f %9.1f %8ld %8ld %9.1f %9.1f %s\n",
+           c.name.c_str(), mb,
+           static_cast<double>(c.data.size()) / (packed.empty() ? 1 : packed.size()),
+           mb / comp.seconds, mb / dec.seconds,
+           comp.rssKB, dec.rssKB,
+           comp.allocs / mb, dec.allocs / mb,
+           comp.ok && dec.ok ? "ok" : "MISMATCH");
+}
+
+/*
+ * benchHashTable
+ * --------------
+ * Inserts n distinct string keys, then looks up every key (hits)
+ * and as many absent keys (misses) through string_view.
+ */
+void benchHashTable(size_t n) {
+    vector<string> keys(n), absent(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = "key-" + to_string(i * 2654435761u);
+        absent[i] = "nokey-" + to_string(i);
+    }
+
+    HashTable<string, size_t> table;
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+        table.insert(keys[i], i);
+    auto t1 = chrono::steady_clock::now();
+
+    size_t found = 0, value;
+    for (size_t i = 0; i < n; ++i)
+        found += table.find(string_view(keys[i]), value);
+    for (size_t i = 0; i < n; ++i)
+        found += table.find(string_view(absent[i]), value);
+    auto t2 = chrono::steady_clock::now();
+
+    double insertNs = chrono::duration<double, nano>(t1 - t0).count() / n;
+    double findNs = chrono::duration<double, nano>(t2 - t1).count() / (2 * n);
+    printf("hashtable %zu keys: insert %.1f ns/op, find %.1f ns/op "
+           "(%zu hits)\n", n, insertNs, findNs, found);
+}
+
+int main(int argc, char *argv[]) {
+    size_t sizeMB = 16;
+    int maxBits = 16;
+    bool useClear = true;
+    int repeat = 3;
+    string silesia = "silesia";
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 7, "--size=") == 0)
+            sizeMB = strtoul(arg.c_str() + 7, nullptr, 10);
+        else if (arg.compare(0, 7, "--bits=") == 0)
+            maxBits = atoi(arg.c_str() + 7);
+        else if (arg == "--no-clear")
+            useClear = false;
+        else if (arg.compare(0, 9, "--repeat=") == 0)
+            repeat = atoi(arg.c_str() + 9);
+        else if (arg.compare(0, 10, "--silesia=") == 0)
+            silesia = arg.substr(10);
+        else {
+            cerr << "Usage: benchmark [--size=MB] [--bits=N] [--no-clear] "
+                    "[--repeat=N] [--silesia=DIR]\n";
+            return 1;
+        }
+    }
+
+    if (sizeMB == 0 || repeat < 1 || maxBits < LZWFormat::MIN_CODE_BITS ||
+        maxBits > LZWFormat::MAX_CODE_BITS) {
+        cerr << "Invalid benchmark settings.\n";
+        return 1;
+    }
+
+    size_t size = sizeMB << 20;
+    vector<Corpus> corpora;
+    corpora.push_back(makeRandom(size));
+    corpora.push_back(makeLogs(size));
+    corpora.push_back(makeText(size));
+    corpora.push_back(makeBinary(size));
+
+    vector<Corpus> local = loadDirectory(silesia);
+    corpora.insert(corpora.end(), local.begin(), local.end());
+
+    printf("LZW codec: %d-bit codes, clear %s, best of %d\n",
+           maxBits, useClear ? "on" : "off", repeat);
+    printf("%-22s %9s %7s %9s %9s %8s %8s %9s %9s\n",
+           "corpus", "MB", "ratio", "comp MB/s", "dec MB/s",
+           "comp rss", "dec rss", "c allocs", "d allocs");
+
+    for (size_t i = 0; i < corpora.size(); ++i)
+        benchCorpus(corpora[i], maxBits, useClear, repeat);
+
+    printf("\n");
+    benchHashTable(1 << 20);
+    return 0;
+}
@@ -3,28 +3,90 @@
 
 #include <vector>
 #include <functional>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*
  * HashTable class
  * ----------------
  * A generic hash table implementation using open addressing
- * with linear probing for collision resolution.
+ * with SIMD group probing (Swiss-table style).
+ *
+ * Slots are organised in groups of 16. Next to the entries there is
+ * one control byte per slot: EMPTY, DELETED, or (for a full slot)
+ * 7 bits of the key's hash. A probe loads a whole group of control
+ * bytes, compares all 16 tags at once (SSE2, or a scalar loop on
+ * other targets) and only compares keys whose tag matches. Probing
+ * stops at the first group that still has an EMPTY slot.
+ *
+ * The table grows automatically once the used slots (entries plus
+ * deleted markers) would exceed the maximum load factor, so a probe
+ * always ends and lookups stay short even at 90% load.
+ *
+ * Every entry also keeps its full hash. Key comparisons only happen
+ * when the stored hash matches, and rehashing never recomputes one.
+ *
+ * Lookups can skip building a Key:
+ *   - with a transparent Hash (HashTableHash<std::string> is one),
+ *     find/insert/remove accept anything the hasher and Key's ==
+ *     accept, e.g. std::string_view or const char *;
+ *   - hash(key) can be computed once and passed to the *Hashed
+ *     variants, e.g. when the same key is probed repeatedly.
  *
  * Key   : type of the key (must be hashable and comparable)
  * Value : type of the value
+ * Hash  : hash function object for Key
  */
-template <class Key, class Value>
+template <class Key>
+struct HashTableHash : std::hash<Key> { };
+
+/*
+ * HashTableHash<std::string>
+ * --------------------------
+ * Transparent string hasher: strings, string_views and C strings
+ * with the same characters hash equally (std::hash guarantees this
+ * for string and string_view), so none of them has to be copied
+ * into a std::string just to be looked up.
+ */
+template <>
+struct HashTableHash<std::string> {
+    typedef void is_transparent;
+
+    size_t operator()(std::string_view s) const {
+        return std::hash<std::string_view>()(s);
+    }
+};
+
+template <class Key, class Value, class Hash = HashTableHash<Key> >
 class HashTable {
 public:
     /*
      * Constructor
      * ------------
-     * Creates a hash table with the given size.
+     * Creates a hash table with room for at least tableSize slots
+     * (rounded up to a power of two, minimum one group).
+     * maxLoad is the fraction of slots that may be used before the
+     * table grows; it is clamped to [0.25, 0.95].
      * Default size is 8192.
      */
-    HashTable(size_t tableSize = 8192) {
-        table.resize(tableSize);
-        makeEmpty();
+    HashTable(size_t tableSize = 8192, double maxLoad = 0.875) {
+        if (maxLoad < 0.25)
+            maxLoad = 0.25;
+        if (maxLoad > 0.95)
+            maxLoad = 0.95;
+        maxLoadFactor = maxLoad;
+
+        size_t capacity = GROUP_SIZE;
+        while (capacity < tableSize)
+            capacity <<= 1;
+        allocate(capacity);
     }
 
     /*
@@ -35,18 +97,37 @@ public:
      * false if the key already exists.
      */
     bool insert(const Key &key, const Value &value) {
-        size_t currentPos = findPos(key);
+        return insertHashed(key, hash(key), value);
+    }
+
+    // Heterogeneous insert: the Key is only built if it is missing.
+    template <class K, class H = Hash, class = typename H::is_transparent>
+    bool insert(const K &key, const Value &value) {
+        return insertHashed(key, hash(key), value);
+    }
 
-        // If the position is already occupied by an active entry,
-        // insertion fails
-        if (isActive(currentPos)) {
+    /*
+     * insertHashed
+     * ------------
+     * insert with a hash computed earlier by hash(key).
+     */
+    template <class K>
+    bool insertHashed(const K &key, size_t keyHash, const Value &value) {
+        if (findSlot(key, keyHash) != NOT_FOUND)
             return false;
-        }
 
-        // Insert the new key-value pair
-        table[currentPos].key = key;
-        table[currentPos].value = value;
-        table[currentPos].info = ACTIVE;
+        // Make room first so the new entry never has to move
+        if (usedSlots + 1 > growLimit)
+            rehash();
+
+        size_t pos = freeSlot(keyHash);
+        if (ctrl[pos] == EMPTY)
+            ++usedSlots;
+
+        ctrl[pos] = tagOf(keyHash);
+        table[pos].key = Key(key);
+        table[pos].value = value;
+        table[pos].hash = keyHash;
         ++currentSize;
 
         return true;
@@ -60,104 +141,281 @@ public:
      * Otherwise, returns false.
      */
     bool find(const Key &key, Value &outValue) const {
-        size_t currentPos = findPos(key);
+        return findHashed(key, hash(key), outValue);
+    }
+
+    // Heterogeneous find (string_view, const char * ... for strings).
+    template <class K, class H = Hash, class = typename H::is_transparent>
+    bool find(const K &key, Value &outValue) const {
+        return findHashed(key, hash(key), outValue);
+    }
 
-        // If the position is not active, the key does not exist
-        if (!isActive(currentPos))
+    /*
+     * findHashed
+     * ----------
+     * find with a hash computed earlier by hash(key).
+     */
+    template <class K>
+    bool findHashed(const K &key, size_t keyHash, Value &outValue) const {
+        size_t pos = findSlot(key, keyHash);
+
+        // No matching slot: the key does not exist
+        if (pos == NOT_FOUND)
             return false;
 
-        outValue = table[currentPos].value;
+        outValue = table[pos].value;
         return true;
     }
 
+    /*
+     * remove
+     * ------
+     * Removes the given key.
+     * Returns true if it was present.
+     */
+    bool remove(const Key &key) {
+        return removeHashed(key, hash(key));
+    }
+
+    // Heterogeneous remove.
+    template <class K, class H = Hash, class = typename H::is_transparent>
+    bool remove(const K &key) {
+        return removeHashed(key, hash(key));
+    }
+
+    /*
+     * removeHashed
+     * ------------
+     * remove with a hash computed earlier by hash(key).
+     */
+    template <class K>
+    bool removeHashed(const K &key, size_t keyHash) {
+        size_t pos = findSlot(key, keyHash);
+        if (pos == NOT_FOUND)
+            return false;
+
+        /*
+         * If the slot's group still has an EMPTY slot, no probe ever
+         * continues past this group, so the slot can become EMPTY
+         * again. Otherwise it must stay a DELETED marker.
+         */
+        size_t groupStart = pos & ~(GROUP_SIZE - 1);
+        if (matchByte(groupStart, EMPTY) != 0) {
+            ctrl[pos] = EMPTY;
+            --usedSlots;
+        } else {
+            ctrl[pos] = DELETED;
+        }
+
+        table[pos] = HashEntry();
+        --currentSize;
+        return true;
+    }
+
+    /*
+     * hash
+     * ----
+     * Computes the hash value of a key (or of anything a transparent
+     * Hash accepts). Hash functions are often the identity for
+     * integers, so the result is mixed (multiplication by a 64-bit
+     * odd constant, high half folded down) to make both the tag bits
+     * and the group bits depend on every key bit.
+     */
+    template <class K>
+    static size_t hash(const K &key) {
+        uint64_t h = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
     /*
      * makeEmpty
      * ---------
      * Clears the hash table by marking all entries as EMPTY.
      */
     void makeEmpty() {
-        currentSize = 0;
-        for (size_t i = 0; i < table.size(); ++i)
-            table[i].info = EMPTY;
+        allocate(table.size());
     }
 
+    // Number of keys in the table.
+    size_t size() const { return currentSize; }
+
+    // Number of slots (entries the table can hold before growing
+    // is capacity() * maximum load factor).
+    size_t capacity() const { return table.size(); }
+
 private:
     /*
-     * EntryType
-     * ---------
-     * Represents the state of a hash table entry.
+     * Control bytes
+     * -------------
+     * EMPTY and DELETED have the high bit set; a full slot stores
+     * the 7-bit tag of its key's hash (high bit clear).
      */
-    enum EntryType { ACTIVE, EMPTY, DELETED };
+    static constexpr uint8_t EMPTY = 0x80;
+    static constexpr uint8_t DELETED = 0xFE;
+    static constexpr size_t GROUP_SIZE = 16;
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
 
     /*
      * HashEntry
      * ---------
      * Represents a single slot in the hash table.
+     * Its state lives in the matching control byte.
      */
     struct HashEntry {
         Key key;
         Value value;
-        EntryType info;
+        size_t hash;    // hash(key), checked before comparing keys
 
         HashEntry(const Key &k = Key(),
                   const Value &v = Value(),
-                  EntryType i = EMPTY)
-            : key(k), value(v), info(i) { }
+                  size_t h = 0)
+            : key(k), value(v), hash(h) { }
     };
 
-    std::vector<HashEntry> table; // Hash table storage
-    size_t currentSize;           // Number of active elements
+    std::vector<HashEntry> table;   // Hash table storage
+    std::vector<uint8_t> ctrl;      // One control byte per slot
+    size_t currentSize;             // Number of active elements
+    size_t usedSlots;               // Active + DELETED slots
+    size_t growLimit;               // usedSlots allowed before rehash
+    double maxLoadFactor;
+
+    // Resets the table to `capacity` EMPTY slots.
+    void allocate(size_t capacity) {
+        table.assign(capacity, HashEntry());
+        ctrl.assign(capacity, EMPTY);
+        currentSize = 0;
+        usedSlots = 0;
+
+        // Always keep at least one EMPTY slot so probes terminate
+        growLimit = static_cast<size_t>(capacity * maxLoadFactor);
+        if (growLimit >= capacity)
+            growLimit = capacity - 1;
+    }
 
     /*
-     * isActive
-     * --------
-     * Returns true if the entry at currentPos is ACTIVE.
+     * rehash
+     * ------
+     * Re-inserts every entry into a fresh table. The capacity doubles
+     * unless most used slots were only DELETED markers, in which case
+     * the same size is enough.
      */
-    bool isActive(size_t currentPos) const {
-        return table[currentPos].info == ACTIVE;
+    void rehash() {
+        size_t capacity = table.size();
+        if ((currentSize + 1) * 2 > growLimit)
+            capacity *= 2;
+
+        std::vector<HashEntry> oldTable;
+        std::vector<uint8_t> oldCtrl;
+        oldTable.swap(table);
+        oldCtrl.swap(ctrl);
+
+        allocate(capacity);
+
+        for (size_t i = 0; i < oldTable.size(); ++i) {
+            if (oldCtrl[i] & EMPTY)
+                continue;
+
+            size_t pos = freeSlot(oldTable[i].hash);
+            ctrl[pos] = oldCtrl[i];
+            table[pos] = std::move(oldTable[i]);
+            ++currentSize;
+            ++usedSlots;
+        }
     }
 
     /*
-     * findPos
-     * -------
-     * Finds the position of a key using linear probing.
-     * If the key exists, returns its position.
-     * Otherwise, returns the position where it can be inserted.
+     * matchByte
+     * ---------
+     * Returns a bit mask of the slots in the group starting at
+     * groupStart whose control byte equals b.
      */
-    size_t findPos(const Key &key) const {
-        size_t currentPos = myhash(key);
-        size_t initialPos = currentPos;
+    unsigned matchByte(size_t groupStart, uint8_t b) const {
+#if defined(__SSE2__)
+        __m128i group = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(&ctrl[groupStart]));
+        __m128i match = _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(b)));
+        return static_cast<unsigned>(_mm_movemask_epi8(match));
+#else
+        unsigned mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i)
+            if (ctrl[groupStart + i] == b)
+                mask |= 1u << i;
+        return mask;
+#endif
+    }
 
-        // Linear probing: move forward until an EMPTY slot
-        // or the key is found
-        while (table[currentPos].info != EMPTY &&
-               !(table[currentPos].key == key)) {
+    // Bit mask of the EMPTY or DELETED slots of a group.
+    unsigned matchFree(size_t groupStart) const {
+#if defined(__SSE2__)
+        __m128i group = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(&ctrl[groupStart]));
+        return static_cast<unsigned>(_mm_movemask_epi8(group));
+#else
+        unsigned mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i)
+            if (ctrl[groupStart + i] & EMPTY)
+                mask |= 1u << i;
+        return mask;
+#endif
+    }
 
-            currentPos++;
+    /*
+     * findSlot
+     * --------
+     * Returns the slot holding key, or NOT_FOUND.
+     * Groups are visited in triangular order (+1, +2, +3 groups ...),
+     * which reaches every group of a power-of-two table.
+     */
+    template <class K>
+    size_t findSlot(const K &key, size_t hash) const {
+        size_t groupMask = table.size() / GROUP_SIZE - 1;
+        size_t group = (hash >> 7) & groupMask;
+        uint8_t tag = tagOf(hash);
 
-            // Wrap around if needed
-            if (currentPos >= table.size())
-                currentPos = 0;
+        for (size_t step = 1; ; ++step) {
+            size_t groupStart = group * GROUP_SIZE;
 
-            // If we return to the initial position, stop
-            if (currentPos == initialPos)
-                break;
-        }
+            for (unsigned m = matchByte(groupStart, tag); m != 0; m &= m - 1) {
+                size_t pos = groupStart + lowestBit(m);
+                if (table[pos].hash == hash && table[pos].key == key)
+                    return pos;
+            }
 
-        return currentPos;
+            if (matchByte(groupStart, EMPTY) != 0)
+                return NOT_FOUND;
+
+            group = (group + step) & groupMask;
+        }
     }
 
     /*
-     * myhash
-     * ------
-     * Computes the hash value of the key
-     * and maps it to the table size.
+     * freeSlot
+     * --------
+     * Returns the first EMPTY or DELETED slot on the probe sequence
+     * of hash. The caller has checked that the key is not present.
      */
-    size_t myhash(const Key &key) const {
-        static std::hash<Key> hf;
-        return hf(key) % table.size();
+    size_t freeSlot(size_t hash) const {
+        size_t groupMask = table.size() / GROUP_SIZE - 1;
+        size_t group = (hash >> 7) & groupMask;
+
+        for (size_t step = 1; ; ++step) {
+            size_t groupStart = group * GROUP_SIZE;
+            unsigned m = matchFree(groupStart);
+            if (m != 0)
+                return groupStart + lowestBit(m);
+
+            group = (group + step) & groupMask;
+        }
+    }
+
+    static unsigned lowestBit(unsigned mask) {
+        return static_cast<unsigned>(__builtin_ctz(mask));
+    }
+
+    // The low 7 bits of the mixed hash are the slot tag.
+    static uint8_t tagOf(size_t hash) {
+        return static_cast<uint8_t>(hash & 0x7F);
     }
 };
 
 #endif
-
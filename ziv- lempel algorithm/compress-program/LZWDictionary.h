@@ -0,0 +1,119 @@
+#ifndef LZWDICTIONARY_H
+#define LZWDICTIONARY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+ * LZWDictionary class
+ * -------------------
+ * Compression dictionary for LZW keyed by (prefixCode, nextByte).
+ *
+ * Every dictionary string is some existing string followed by one
+ * byte, so it is fully identified by the code of that prefix and the
+ * byte. Both fit into one 32-bit integer, which is stored in a flat
+ * open-addressed table (linear probing, power-of-two size, load
+ * factor <= 1/2). A lookup is a hash, a few integer compares and no
+ * string building.
+ *
+ * The 256 single-byte strings are implicit: code i is byte i.
+ */
+class LZWDictionary {
+public:
+    /*
+     * Constructor
+     * ------------
+     * Creates a dictionary able to hold maxCodes codes.
+     */
+    explicit LZWDictionary(size_t maxCodes) {
+        size_t size = 1;
+        shift = 32;
+        while (size < 2 * maxCodes) {
+            size <<= 1;
+            --shift;
+        }
+        mask = size - 1;
+        table.resize(size);
+        makeEmpty();
+    }
+
+    /*
+     * find
+     * ----
+     * Returns the code of string(prefix) + byte,
+     * or -1 if it is not in the dictionary.
+     */
+    int find(uint32_t prefix, unsigned char byte) const {
+        uint32_t key = makeKey(prefix, byte);
+        size_t pos = slotOf(key);
+
+        while (table[pos].key != EMPTY_KEY) {
+            if (table[pos].key == key)
+                return static_cast<int>(table[pos].code);
+            pos = (pos + 1) & mask;
+        }
+        return -1;
+    }
+
+    /*
+     * insert
+     * ------
+     * Adds string(prefix) + byte with the given code.
+     * The caller guarantees the entry is not present yet
+     * (it has just been looked up with find).
+     */
+    void insert(uint32_t prefix, unsigned char byte, uint32_t code) {
+        uint32_t key = makeKey(prefix, byte);
+        size_t pos = slotOf(key);
+
+        while (table[pos].key != EMPTY_KEY)
+            pos = (pos + 1) & mask;
+
+        table[pos].key = key;
+        table[pos].code = code;
+    }
+
+    /*
+     * makeEmpty
+     * ---------
+     * Removes every multi-byte entry.
+     */
+    void makeEmpty() {
+        for (size_t i = 0; i < table.size(); ++i)
+            table[i].key = EMPTY_KEY;
+    }
+
+private:
+    static const uint32_t EMPTY_KEY = 0xFFFFFFFFu;
+
+    /*
+     * Slot
+     * ----
+     * One table entry: packed (prefix, byte) key and its code.
+     */
+    struct Slot {
+        uint32_t key;
+        uint32_t code;
+    };
+
+    std::vector<Slot> table; // Slot storage
+    size_t mask;             // table.size() - 1
+    int shift;               // 32 - log2(table.size())
+
+    static uint32_t makeKey(uint32_t prefix, unsigned char byte) {
+        return (prefix << 8) | byte;
+    }
+
+    /*
+     * slotOf
+     * ------
+     * Fibonacci hashing: the top bits of key * 2^32/phi
+     * spread consecutive prefixes across the table.
+     */
+    size_t slotOf(uint32_t key) const {
+        return static_cast<size_t>((key * 2654435769u) >> shift) & mask;
+    }
+};
+
+#endif
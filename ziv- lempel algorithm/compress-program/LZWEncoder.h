@@ -0,0 +1,176 @@
+#ifndef LZWENCODER_H
+#define LZWENCODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "LZWDictionary.h"
+#include "../LZWFormat.h"
+
+/*
+ * Constants
+ * ---------
+ * CHECK_GAP : Input bytes between compression ratio checks
+ *             once the dictionary is full
+ */
+const uint64_t CHECK_GAP = 10000;
+
+/*
+ * LZWEncoder class
+ * ----------------
+ * The LZW compression state: dictionary, current string p and
+ * code width. Input may arrive in any number of pieces through
+ * update(); finish() writes the code of the last string.
+ *
+ * With useClear, a full dictionary is watched like compress(1) does:
+ * every CHECK_GAP input bytes the ratio since the last reset is
+ * compared with the best one seen, and once it drops a CLEAR_CODE
+ * is written and the dictionary starts over.
+ */
+class LZWEncoder {
+public:
+    LZWEncoder(int maxBits, bool useClear)
+        : maxBits(maxBits), maxCodes(1 << maxBits), useClear(useClear),
+          firstCode(LZWFormat::firstCode(useClear ? LZWFormat::FLAG_CLEAR : 0)),
+          dict(maxCodes), nextCode(firstCode),
+          codeWidth(LZWFormat::MIN_CODE_BITS), p(0), started(false),
+          inCount(0), outBits(0), checkpoint(CHECK_GAP), bestRatio(0),
+          resetAt(0) { }
+
+    /*
+     * update
+     * ------
+     * Compresses size bytes, writing finished codes to bits.
+     */
+    template <class Sink>
+    void update(const unsigned char *data, size_t size,
+                LZWFormat::BitWriter<Sink> &bits) {
+        size_t i = 0;
+
+        // p is kept as its dictionary code; start with the first character
+        if (!started) {
+            if (size == 0)
+                return;
+            p = data[0];
+            started = true;
+            i = 1;
+        }
+
+        for (; i < size; ++i) {
+            unsigned char byte = data[i];
+            int codePC = dict.find(p, byte);
+
+            /*
+             * If p+c exists in the dictionary,
+             * extend the current string.
+             */
+            if (codePC >= 0) {
+                p = codePC;
+            }
+            /*
+             * Otherwise:
+             * 1. Output the code for p
+             * 2. Add p+c to the dictionary (or clear a full one)
+             * 3. Reset p to the current character
+             */
+            else {
+                // Output the code at the current width
+                bits.write(p, codeWidth);
+                outBits += codeWidth;
+
+                // Add new entry to the dictionary if space is available
+                if (nextCode < maxCodes) {
+                    dict.insert(p, byte, nextCode);
+                    nextCode++;
+                }
+                // Full: start over if the ratio has gone down
+                else if (useClear && inCount + i >= checkpoint &&
+                         ratioDropped(inCount + i)) {
+                    bits.write(LZWFormat::CLEAR_CODE, codeWidth);
+                    reset(inCount + i);
+                }
+
+                // Widen codes once the largest possible next code needs it
+                LZWFormat::growWidth(codeWidth, nextCode - 1, maxBits);
+
+                // Reset p to the current character
+                p = byte;
+            }
+        }
+
+        inCount += size;
+    }
+
+    /*
+     * finish
+     * ------
+     * Outputs the code for the last string p and pads the last byte.
+     */
+    template <class Sink>
+    void finish(LZWFormat::BitWriter<Sink> &bits) {
+        if (started)
+            bits.write(p, codeWidth);
+        bits.flush();
+    }
+
+private:
+    int maxBits;        // Widest code written
+    int maxCodes;       // Maximum number of dictionary entries, 2^maxBits
+    bool useClear;      // CLEAR_CODE may be written
+    int firstCode;      // First code of a multi-byte string
+
+    /*
+     * Dictionary
+     * ----------
+     * Maps (code of p, next byte) to the code of p+c.
+     * Codes 0–255 (single characters) are implicit.
+     */
+    LZWDictionary dict;
+
+    int nextCode;     // Next available dictionary code
+    int codeWidth;    // Current code width; grows as the dictionary fills up
+    uint32_t p;       // Code of the current string
+    bool started;     // p holds at least one character
+
+    /*
+     * Ratio tracking for CLEAR_CODE
+     * -----------------------------
+     * inCount counts input bytes before the current update() call;
+     * outBits, checkpoint and bestRatio cover the input since the
+     * last reset (position resetAt).
+     */
+    uint64_t inCount;
+    uint64_t outBits;
+    uint64_t checkpoint;
+    double bestRatio;
+    uint64_t resetAt;
+
+    /*
+     * ratioDropped
+     * ------------
+     * Called at input position pos once the dictionary is full and a
+     * checkpoint has been passed. Returns true if the ratio since the
+     * last reset is worse than at the previous checkpoint.
+     */
+    bool ratioDropped(uint64_t pos) {
+        checkpoint = pos + CHECK_GAP;
+
+        double ratio = static_cast<double>(pos - resetAt) * 8 / outBits;
+        if (ratio >= bestRatio) {
+            bestRatio = ratio;
+            return false;
+        }
+        return true;
+    }
+
+    // Empties the dictionary after a CLEAR_CODE at input position pos.
+    void reset(uint64_t pos) {
+        dict.makeEmpty();
+        nextCode = firstCode;
+        codeWidth = LZWFormat::MIN_CODE_BITS;
+        resetAt = pos;
+        outBits = 0;
+        bestRatio = 0;
+    }
+};
+
+#endif
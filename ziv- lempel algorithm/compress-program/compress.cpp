@@ -1,139 +1,287 @@
 #include <iostream>
-#include <fstream>
 #include <string>
-#include "HashTable.h"
+#include <vector>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include "LZWEncoder.h"
+#include "../LZW.h"
+#include "../LZWFormat.h"
+#include "../../common/ThreadPool.h"
 
 using namespace std;
 
 /*
  * Constants
  * ---------
- * MAX_CODES  : Maximum number of dictionary entries (4096 = 2^12)
- * FIRST_CODE : First available code after ASCII characters
+ * DEFAULT_MAX_BITS : Widest code written unless --bits says otherwise
+ *                    (2^16 dictionary entries, as in compress(1))
  */
-const int MAX_CODES = 4096;
-const int FIRST_CODE = 256;
+const int DEFAULT_MAX_BITS = 16;
 
-int main() {
-    /*
-     * Input and output files
-     * ----------------------
-     * "compin"  : original input file (binary mode)
-     * "compout" : compressed output file (text, codes separated by spaces)
-     */
-    ifstream in("compin", ios::binary);
-    ofstream out("compout");
+/*
+ * Block mode
+ * ----------
+ * DEFAULT_BLOCK_SIZE : Block size used by a plain --blocks
+ * MAX_BLOCK_SIZE     : Largest block whose frame sizes fit in 32 bits
+ *                      (codes are at most 20 bits per input byte, so
+ *                      packed data can be up to 2.5 times the raw size)
+ * MAX_BATCH_BYTES    : Raw bytes read per batch at most; large blocks
+ *                      get fewer threads rather than more memory
+ */
+const size_t DEFAULT_BLOCK_SIZE = 4 << 20;
+const size_t MAX_BLOCK_SIZE = 1 << 30;
+const size_t MAX_BATCH_BYTES = size_t(1) << 30;
 
-    // Check if input file opened successfully
-    if (!in) {
-        cerr << "Cannot open compin.\n";
-        return 1;
-    }
+/*
+ * compressBlock
+ * -------------
+ * Compresses one independent block with a fresh dictionary
+ * into packed (replacing its previous contents).
+ */
+void compressBlock(const unsigned char *data, size_t size,
+                   const LZWFormat::Header &header,
+                   vector<unsigned char> &packed) {
+    packed.clear();
+    StreamIO::MemorySink sink(packed);
+    LZWFormat::BitWriter<StreamIO::MemorySink> bits(sink);
 
-    // Check if output file opened successfully
-    if (!out) {
-        cerr << "Cannot open compout.\n";
-        return 1;
-    }
+    LZWEncoder encoder(header.maxBits,
+                       (header.flags & LZWFormat::FLAG_CLEAR) != 0);
+    encoder.update(data, size, bits);
+    encoder.finish(bits);
+}
 
-    /*
-     * Dictionary
-     * ----------
-     * HashTable mapping strings to integer codes.
-     * Used for fast lookup during compression.
-     */
-    HashTable<string, int> dict;
+/*
+ * compressBlocks
+ * --------------
+ * Block mode: reads the input one batch of blocks at a time,
+ * compresses the blocks of a batch in parallel and writes their
+ * frames in input order, followed by the end frame and the
+ * seekable index.
+ */
+void compressBlocks(StreamIO::ByteSource &in, StreamIO::ByteSink &out,
+                    const LZWFormat::Header &header, size_t blockSize,
+                    ThreadPool &pool) {
+    // Two blocks per thread keeps every core busy, as far as
+    // MAX_BATCH_BYTES allows (at least one block per batch)
+    size_t batchBlocks = 2 * pool.size();
+    if (batchBlocks > MAX_BATCH_BYTES / blockSize)
+        batchBlocks = MAX_BATCH_BYTES / blockSize;
+    if (batchBlocks == 0)
+        batchBlocks = 1;
 
-    /*
-     * Initialize dictionary with single-character ASCII strings
-     * Codes 0–255 represent standard ASCII characters.
-     */
-    for (int i = 0; i < 256; ++i) {
-        string s(1, static_cast<char>(i));
-        dict.insert(s, i);
+    vector<unsigned char> input(batchBlocks * blockSize);
+    vector<vector<unsigned char> > packed(batchBlocks);
+
+    // File offset of every frame, for the index
+    vector<uint64_t> frameOffsets;
+    uint64_t offset = LZWFormat::HEADER_SIZE;
+
+    for (;;) {
+        size_t got = in.read(input.data(), input.size());
+        if (got == 0)
+            break;
+
+        size_t blocks = (got + blockSize - 1) / blockSize;
+        pool.parallelFor(blocks, [&](size_t b) {
+            size_t begin = b * blockSize;
+            size_t size = got - begin < blockSize ? got - begin : blockSize;
+            compressBlock(input.data() + begin, size, header, packed[b]);
+        });
+
+        for (size_t b = 0; b < blocks; ++b) {
+            size_t begin = b * blockSize;
+            size_t size = got - begin < blockSize ? got - begin : blockSize;
+            LZWFormat::writeFrame(out, static_cast<uint32_t>(size),
+                                  static_cast<uint32_t>(packed[b].size()));
+            out.write(packed[b].data(), packed[b].size());
+
+            frameOffsets.push_back(offset);
+            offset += LZWFormat::FRAME_SIZE + packed[b].size();
+        }
+
+        if (got < input.size())
+            break;
     }
 
-    // Next available dictionary code
-    int nextCode = FIRST_CODE;
+    LZWFormat::writeFrame(out, 0, 0);
+    offset += LZWFormat::FRAME_SIZE;
 
-    char c;
-    string p;
+    LZWFormat::writeIndex(out, frameOffsets, offset,
+                          static_cast<uint32_t>(blockSize));
+}
 
-    /*
-     * Read the first character
-     * ------------------------
-     * If the file is empty, exit.
-     */
-    if (!in.get(c)) {
+/*
+ * parseCount
+ * ----------
+ * Parses a decimal count (digits only: no sign, which strtoull would
+ * accept and wrap) and stores where the digits end in end.
+ * Returns 0 if there are no digits or the count is too large.
+ */
+unsigned long long parseCount(const char *text, char **end) {
+    *end = const_cast<char *>(text);
+    if (!isdigit(static_cast<unsigned char>(*text)))
         return 0;
-    }
 
-    // Initialize p with the first character
-    p = string(1, c);
+    errno = 0;
+    unsigned long long value = strtoull(text, end, 10);
+    return errno == ERANGE ? 0 : value;
+}
 
-    // Used to format output (no leading space for first code)
-    bool firstOutput = true;
+/*
+ * parseSize
+ * ---------
+ * Parses a byte count with an optional K or M suffix ("4M").
+ * Returns 0 if the text is not a valid size or does not fit.
+ */
+size_t parseSize(const string &text) {
+    char *end;
+    unsigned long long value = parseCount(text.c_str(), &end);
 
-    /*
-     * Main compression loop (LZW)
-     * ---------------------------
-     * Reads characters one by one and builds dictionary entries.
-     */
-    while (in.get(c)) {
-        string pc = p + c;
-        int dummy;
+    string suffix = end;
+    int shift = 0;
+    if (suffix == "K" || suffix == "k")
+        shift = 10;
+    else if (suffix == "M" || suffix == "m")
+        shift = 20;
+    else if (!suffix.empty())
+        return 0;
 
-        /*
-         * If p+c exists in the dictionary,
-         * extend the current string.
-         */
-        if (dict.find(pc, dummy)) {
-            p = pc;
-        }
-        /*
-         * Otherwise:
-         * 1. Output the code for p
-         * 2. Add p+c to the dictionary
-         * 3. Reset p to the current character
-         */
-        else {
-            int codeP;
-            dict.find(p, codeP);
-
-            // Output the code with correct spacing
-            if (firstOutput) {
-                out << codeP;
-                firstOutput = false;
-            } else {
-                out << " " << codeP;
-            }
+    if (value > (SIZE_MAX >> shift))
+        return 0;
+    return static_cast<size_t>(value) << shift;
+}
 
-            // Add new entry to the dictionary if space is available
-            if (nextCode < MAX_CODES) {
-                dict.insert(pc, nextCode);
-                nextCode++;
-            }
+/*
+ * Usage: compress [--mmap] [--bits=N] [--no-clear] [--blocks[=SIZE]]
+ *                 [--threads=N] [input [output]]
+ * -------------------------------------------------------------------
+ * input      defaults to "compin",  "-" reads stdin
+ * output     defaults to "compout", "-" writes stdout
+ * --mmap     maps a regular input file instead of reading it
+ * --bits     widest code, 9 to 20 (default 16)
+ * --no-clear never reset the dictionary once it is full
+ * --blocks   splits the input into independent blocks of SIZE bytes
+ *            (default 4M, K/M suffixes allowed) compressed in parallel;
+ *            the output ends with an index for decompress --range
+ * --threads  number of compression threads in block mode
+ *            (default: one per core, at most four per core); each batch holds two blocks
+ *            per thread, but no more than 1 GB of input (and up to
+ *            2.5 times that packed), so large blocks use fewer threads
+ */
+int main(int argc, char *argv[]) {
+    const char *usage =
+        "Usage: compress [--mmap] [--bits=N] [--no-clear] [--blocks[=SIZE]] "
+        "[--threads=N] [input [output]]\n";
 
-            // Reset p to the current character
-            p = string(1, c);
+    string inName = "compin";
+    string outName = "compout";
+    bool useMmap = false;
+    int maxBits = DEFAULT_MAX_BITS;
+    bool useClear = true;
+    size_t blockSize = 0;     // 0: single stream
+    size_t threads = 0;       // 0: one per core
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--mmap") {
+            useMmap = true;
+        } else if (arg.compare(0, 7, "--bits=") == 0) {
+            maxBits = atoi(arg.c_str() + 7);
+            if (maxBits < LZWFormat::MIN_CODE_BITS ||
+                maxBits > LZWFormat::MAX_CODE_BITS) {
+                cerr << usage;
+                return 1;
+            }
+        } else if (arg == "--no-clear") {
+            useClear = false;
+        } else if (arg == "--blocks") {
+            blockSize = DEFAULT_BLOCK_SIZE;
+        } else if (arg.compare(0, 9, "--blocks=") == 0) {
+            blockSize = parseSize(arg.substr(9));
+            if (blockSize == 0 || blockSize > MAX_BLOCK_SIZE) {
+                cerr << usage;
+                return 1;
+            }
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            char *end;
+            threads = parseCount(arg.c_str() + 10, &end);
+            if (threads == 0 || *end != '\0' ||
+                threads > ThreadPool::maxThreads()) {
+                cerr << usage;
+                return 1;
+            }
+        } else if (positional == 0) {
+            inName = arg;
+            ++positional;
+        } else if (positional == 1) {
+            outName = arg;
+            ++positional;
+        } else {
+            cerr << usage;
+            return 1;
         }
     }
 
     /*
-     * Output the code for the last string p
+     * Input and output streams
+     * ------------------------
+     * input  : original data (binary)
+     * output : compressed data (binary, see LZWFormat.h)
      */
-    if (!p.empty()) {
-        int codeP;
-        dict.find(p, codeP);
-
-        if (firstOutput)
-            out << codeP;
-        else
-            out << " " << codeP;
+    StreamIO::ByteSource in(inName, useMmap);
+    StreamIO::ByteSink out(outName);
+
+    // Check if input file opened successfully
+    if (!in) {
+        cerr << "Cannot open " << inName << ".\n";
+        return 1;
+    }
+
+    // Check if output file opened successfully
+    if (!out) {
+        cerr << "Cannot open " << outName << ".\n";
+        return 1;
     }
 
-    // Trailing space (used by the decompressor)
-    out << " ";
+    if (blockSize) {
+        LZWFormat::Header header;
+        header.maxBits = maxBits;
+        header.flags = LZWFormat::FLAG_BLOCKS | LZWFormat::FLAG_INDEX |
+                       (useClear ? LZWFormat::FLAG_CLEAR : 0);
+        LZWFormat::writeHeader(out, header);
+
+        ThreadPool pool(threads);
+        compressBlocks(in, out, header, blockSize, pool);
+    } else {
+        /*
+         * Single stream: feed the input chunk by chunk
+         * through one compressor.
+         */
+        LZW::Options options;
+        options.maxBits = maxBits;
+        options.useClear = useClear;
+        LZW::Compressor<StreamIO::ByteSink> compressor(out, options);
+
+        const unsigned char *data;
+        size_t size;
+        while (in.next(data, size))
+            compressor.update(data, size);
+
+        compressor.finish();
+    }
+
+    if (!in) {
+        cerr << "Error reading " << inName << ".\n";
+        return 1;
+    }
+    if (!out.flush()) {
+        cerr << "Error writing " << outName << ".\n";
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,214 @@
+#ifndef LZWDECODER_H
+#define LZWDECODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "../LZWFormat.h"
+
+/*
+ * Constants
+ * ---------
+ * LITERALS : Number of single-character codes (0–255)
+ *
+ * The maximum number of dictionary entries is 2^maxBits and the
+ * first free code depends on FLAG_CLEAR; both come from the header.
+ */
+const uint32_t LITERALS = 256;
+
+/*
+ * DictEntry
+ * ---------
+ * A dictionary string stored as (prefix code, last byte, length):
+ * string(code) = string(prefix) + byte. Entries never own memory,
+ * so the whole dictionary is one flat array.
+ */
+struct DictEntry {
+    uint32_t prefix;     // code of the string without its last byte
+    uint32_t length;     // number of bytes in the string
+    unsigned char byte;  // last byte of the string
+};
+
+/*
+ * writePhrase
+ * -----------
+ * Writes string(code) into dest[0 .. length) by following the
+ * prefix chain from the last byte back to the first one.
+ */
+inline void writePhrase(const DictEntry *dict, uint32_t code,
+                        unsigned char *dest) {
+    unsigned char *p = dest + dict[code].length;
+    while (code >= LITERALS) {
+        *--p = dict[code].byte;
+        code = dict[code].prefix;
+    }
+    *--p = static_cast<unsigned char>(code);
+}
+
+/*
+ * LZWDecoder class
+ * ----------------
+ * Decodes one code stream (a whole single-stream file, or one
+ * block of a framed file) with a fresh dictionary.
+ *
+ * decode() may be called again after it ran out of input: the
+ * dictionary, the previous string and the partial code held by the
+ * BitReader carry over, so a stream can be decoded piece by piece.
+ */
+class LZWDecoder {
+public:
+    explicit LZWDecoder(const LZWFormat::Header &header)
+        : maxBits(header.maxBits), maxCodes(1 << header.maxBits),
+          useClear((header.flags & LZWFormat::FLAG_CLEAR) != 0),
+          firstCode(LZWFormat::firstCode(header.flags)), dict(maxCodes),
+          nextCode(firstCode), codeWidth(LZWFormat::MIN_CODE_BITS),
+          havePrev(false), prevCode(0), prevFirst(0), error(nullptr) {
+        /*
+         * Initialize dictionary with single-character ASCII strings
+         * Codes 0–255 correspond to standard ASCII characters.
+         */
+        for (int i = 0; i < 256; ++i) {
+            dict[i].prefix = 0;
+            dict[i].length = 1;
+            dict[i].byte = static_cast<unsigned char>(i);
+        }
+    }
+
+    // Description of the last decoding error, or nullptr.
+    const char *lastError() const { return error; }
+
+    /*
+     * decode
+     * ------
+     * Reads codes until the input runs out and writes the strings to
+     * out. Returns false (see lastError) if the code stream is corrupt;
+     * after that every call fails.
+     */
+    template <class Source, class Sink>
+    bool decode(LZWFormat::BitReader<Source> &bits, Sink &out) {
+        if (error)
+            return false;
+
+        /*
+         * Main decompression loop
+         * -----------------------
+         * Reads codes one by one and writes each string straight into
+         * the output buffer; nothing is allocated per code.
+         */
+        uint32_t currCode;
+        for (;;) {
+            /*
+             * First code of the stream (or after CLEAR_CODE)
+             * ----------------------------------------------
+             * Always a single character; starts the previous string.
+             */
+            if (!havePrev) {
+                if (!bits.read(prevCode, codeWidth))
+                    return true;
+
+                if (prevCode >= LITERALS) {
+                    error = "invalid first code";
+                    return false;
+                }
+
+                out.put(static_cast<unsigned char>(prevCode));
+                prevFirst = static_cast<unsigned char>(prevCode);
+                havePrev = true;
+                continue;
+            }
+
+            /*
+             * The largest code the compressor could have written next is
+             * nextCode (the special case below), capped by the table size.
+             */
+            uint32_t maxCode = nextCode < maxCodes ? nextCode : maxCodes - 1;
+            LZWFormat::growWidth(codeWidth, maxCode, maxBits);
+
+            if (!bits.read(currCode, codeWidth))
+                return true;
+
+            if (currCode > maxCode) {
+                error = "code out of range";
+                return false;
+            }
+
+            /*
+             * CLEAR_CODE: forget every multi-byte entry and start over.
+             * The next code is read like the first one of a stream.
+             */
+            if (useClear && currCode == LZWFormat::CLEAR_CODE) {
+                nextCode = firstCode;
+                codeWidth = LZWFormat::MIN_CODE_BITS;
+                havePrev = false;
+                continue;
+            }
+
+            uint32_t prevLength = dict[prevCode].length;
+            unsigned char *dest;
+
+            /*
+             * If the current code already exists in the dictionary,
+             * write the corresponding string.
+             */
+            if (currCode < nextCode) {
+                dest = out.append(dict[currCode].length);
+                writePhrase(dict.data(), currCode, dest);
+            }
+            /*
+             * Special LZW case:
+             * If the code is not yet in the dictionary,
+             * the entry is previous string + its first character.
+             */
+            else {
+                dest = out.append(prevLength + 1);
+                writePhrase(dict.data(), prevCode, dest);
+                dest[prevLength] = prevFirst;
+            }
+
+            /*
+             * Add a new entry to the dictionary:
+             * previous string + first character of current entry
+             */
+            if (nextCode < maxCodes) {
+                dict[nextCode].prefix = prevCode;
+                dict[nextCode].length = prevLength + 1;
+                dict[nextCode].byte = dest[0];
+                nextCode++;
+            }
+
+            // Update previous string for the next iteration
+            prevCode = currCode;
+            prevFirst = dest[0];
+        }
+    }
+
+private:
+    int maxBits;            // Widest code in the stream (from the header)
+    uint32_t maxCodes;      // Maximum number of dictionary entries, 2^maxBits
+    bool useClear;          // CLEAR_CODE resets the dictionary
+    uint32_t firstCode;     // First code of a multi-byte string
+
+    /*
+     * Dictionary
+     * ----------
+     * Flat table of (prefix, byte, length) entries indexed by code.
+     * Size is fixed to maxCodes.
+     */
+    std::vector<DictEntry> dict;
+
+    /*
+     * Decoding state
+     * --------------
+     * Kept between decode() calls.
+     */
+    uint32_t nextCode;       // Next available dictionary code
+    int codeWidth;           // Follows the same growth rule as the compressor
+    bool havePrev;           // prevCode holds a string (false at the start
+                             // and after CLEAR_CODE)
+    uint32_t prevCode;       // Code of the previous string
+    unsigned char prevFirst; // First byte of the previous string
+
+    const char *error;
+};
+
+#endif
@@ -1,115 +1,372 @@
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <vector>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include "LZWDecoder.h"
+#include "../LZW.h"
+#include "../LZWFormat.h"
+#include "../../common/ThreadPool.h"
 
 using namespace std;
 
 /*
- * Constants
- * ---------
- * MAX_CODES  : Maximum number of dictionary entries (2^12 for LZW)
- * FIRST_CODE : First available code after ASCII characters
+ * Block
+ * -----
+ * One frame of a block-mode file: its packed code stream on the
+ * way in and the decoded bytes on the way out.
  */
-const int MAX_CODES = 4096;
-const int FIRST_CODE = 256;
+struct Block {
+    uint32_t rawSize;
+    vector<unsigned char> packed;
+    vector<unsigned char> raw;
+    const char *error;
+};
+
+/*
+ * decodeBlock
+ * -----------
+ * Decodes block.packed into block.raw with a fresh dictionary and
+ * sets block.error if the data is corrupt.
+ */
+void decodeBlock(Block &block, const LZWFormat::Header &header) {
+    block.raw.clear();
+    block.raw.reserve(block.rawSize);
+    block.error = nullptr;
+
+    StreamIO::MemorySource source(block.packed.data(), block.packed.size());
+    StreamIO::MemorySink sink(block.raw);
+    LZWFormat::BitReader<StreamIO::MemorySource> bits(source);
+
+    LZWDecoder decoder(header);
+    if (!decoder.decode(bits, sink))
+        block.error = decoder.lastError();
+    else if (block.raw.size() != block.rawSize)
+        block.error = "block size mismatch";
+}
+
+/*
+ * decompressBlocks
+ * ----------------
+ * Block mode: reads a batch of frames, decodes its blocks in
+ * parallel (each has its own dictionary) and writes them in order
+ * until the end frame. Returns false on corrupt or truncated input.
+ */
+bool decompressBlocks(StreamIO::ByteSource &in, StreamIO::ByteSink &out,
+                      const LZWFormat::Header &header, ThreadPool &pool) {
+    // Two blocks per thread keeps every core busy while memory stays bounded
+    vector<Block> batch(2 * pool.size());
+
+    for (;;) {
+        // Collect up to batch.size() frames
+        size_t blocks = 0;
+        bool sawEnd = false;
+        while (blocks < batch.size()) {
+            uint32_t rawSize, packedSize;
+            if (!LZWFormat::readFrame(in, rawSize, packedSize)) {
+                cerr << "Corrupt input: truncated block frame.\n";
+                return false;
+            }
+            if (rawSize == 0) {
+                sawEnd = true;
+                break;
+            }
+
+            Block &block = batch[blocks++];
+            block.rawSize = rawSize;
+            block.packed.resize(packedSize);
+            if (in.read(block.packed.data(), packedSize) != packedSize) {
+                cerr << "Corrupt input: truncated block.\n";
+                return false;
+            }
+        }
+
+        pool.parallelFor(blocks, [&](size_t b) {
+            decodeBlock(batch[b], header);
+        });
+
+        for (size_t b = 0; b < blocks; ++b) {
+            if (batch[b].error) {
+                cerr << "Corrupt input: " << batch[b].error << ".\n";
+                return false;
+            }
+            out.write(batch[b].raw.data(), batch[b].raw.size());
+        }
+
+        if (sawEnd)
+            return true;
+    }
+}
+
+/*
+ * decompressRange
+ * ---------------
+ * Random access: decodes only the blocks that cover the original
+ * bytes [offset, offset + length) and writes exactly that range
+ * (shorter if it runs past the end of the data). Uses the trailing
+ * index, so the cost depends on the blocks read, not the file size.
+ * Returns false if the file has no usable index or is corrupt.
+ */
+bool decompressRange(StreamIO::ByteSource &in, StreamIO::ByteSink &out,
+                     const LZWFormat::Header &header, uint64_t offset,
+                     uint64_t length, ThreadPool &pool) {
+    LZWFormat::Trailer trailer;
+    if (!(header.flags & LZWFormat::FLAG_INDEX) ||
+        !LZWFormat::readTrailer(in, trailer)) {
+        cerr << "--range needs a seekable file written with --blocks.\n";
+        return false;
+    }
+
+    // The range ends at most at the largest offset (no wrap-around below)
+    if (length > UINT64_MAX - offset)
+        length = UINT64_MAX - offset;
+
+    uint64_t blockSize = trailer.blockSize;
+    if (length == 0 || offset / blockSize >= trailer.blockCount)
+        return true;
+
+    uint64_t first = offset / blockSize;
+    uint64_t last = (offset + length - 1) / blockSize;
+    if (last >= trailer.blockCount)
+        last = trailer.blockCount - 1;
+
+    // Two blocks per thread keeps every core busy while memory stays bounded
+    vector<Block> batch(2 * pool.size());
+
+    for (uint64_t start = first; start <= last; start += batch.size()) {
+        size_t blocks = static_cast<size_t>(
+            last - start + 1 < batch.size() ? last - start + 1 : batch.size());
+
+        // Look up each block in the index and read its frame
+        for (size_t b = 0; b < blocks; ++b) {
+            uint64_t index = start + b;
+            unsigned char entry[LZWFormat::INDEX_ENTRY_SIZE];
+            unsigned char frame[LZWFormat::FRAME_SIZE];
+
+            if (!in.readAt(trailer.indexOffset +
+                           index * LZWFormat::INDEX_ENTRY_SIZE,
+                           entry, sizeof(entry))) {
+                cerr << "Corrupt input: truncated index.\n";
+                return false;
+            }
+
+            uint64_t frameOffset = LZWFormat::getU64(entry);
+            if (!in.readAt(frameOffset, frame, sizeof(frame))) {
+                cerr << "Corrupt input: bad index entry.\n";
+                return false;
+            }
+
+            Block &block = batch[b];
+            block.rawSize = LZWFormat::getU32(frame);
+            uint32_t packedSize = LZWFormat::getU32(frame + 4);
+
+            bool lastBlock = index + 1 == trailer.blockCount;
+            if (block.rawSize == 0 || block.rawSize > blockSize ||
+                (!lastBlock && block.rawSize != blockSize)) {
+                cerr << "Corrupt input: bad block size.\n";
+                return false;
+            }
+
+            block.packed.resize(packedSize);
+            if (!in.readAt(frameOffset + LZWFormat::FRAME_SIZE,
+                           block.packed.data(), packedSize)) {
+                cerr << "Corrupt input: truncated block.\n";
+                return false;
+            }
+        }
+
+        pool.parallelFor(blocks, [&](size_t b) {
+            decodeBlock(batch[b], header);
+        });
+
+        // Write the part of each block that lies inside the range
+        for (size_t b = 0; b < blocks; ++b) {
+            if (batch[b].error) {
+                cerr << "Corrupt input: " << batch[b].error << ".\n";
+                return false;
+            }
+
+            uint64_t blockStart = (start + b) * blockSize;
+            uint64_t from = offset > blockStart ? offset - blockStart : 0;
+            uint64_t to = batch[b].raw.size();
+            if (offset + length - blockStart < to)
+                to = offset + length - blockStart;
+
+            if (from < to)
+                out.write(batch[b].raw.data() + from,
+                          static_cast<size_t>(to - from));
+        }
+    }
+
+    return true;
+}
+
+/*
+ * parseRange
+ * ----------
+ * Parses "OFFSET:LENGTH" (decimal byte counts, digits only: no
+ * sign, which strtoull would accept and wrap).
+ * Returns false if the text is malformed or a count is too large.
+ */
+bool parseRange(const string &text, uint64_t &offset, uint64_t &length) {
+    size_t colon = text.find(':');
+    if (colon == string::npos || colon == 0 || colon + 1 == text.size() ||
+        !isdigit(static_cast<unsigned char>(text[0])) ||
+        !isdigit(static_cast<unsigned char>(text[colon + 1])))
+        return false;
+
+    char *end;
+    errno = 0;
+    offset = strtoull(text.c_str(), &end, 10);
+    if (end != text.c_str() + colon)
+        return false;
+
+    length = strtoull(text.c_str() + colon + 1, &end, 10);
+    return *end == '\0' && errno != ERANGE;
+}
+
+/*
+ * parseThreads
+ * ------------
+ * Parses a thread count (digits only) from 1 to ThreadPool::maxThreads().
+ * Returns false if the text is malformed or the count out of range.
+ */
+bool parseThreads(const string &text, size_t &threads) {
+    if (text.empty() || !isdigit(static_cast<unsigned char>(text[0])))
+        return false;
+
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || value == 0 ||
+        value > ThreadPool::maxThreads())
+        return false;
+
+    threads = static_cast<size_t>(value);
+    return true;
+}
+
+/*
+ * Usage: decompress [--mmap] [--threads=N] [--range=OFFSET:LENGTH]
+ *                   [input [output]]
+ * -----------------------------------------------------------------
+ * input     defaults to "compout",   "-" reads stdin
+ * output    defaults to "decompout", "-" writes stdout
+ * --mmap    maps a regular input file instead of reading it
+ * --threads number of decoding threads for block-mode files
+ *           (default: one per core, at most four per core)
+ * --range   writes only the original bytes [OFFSET, OFFSET+LENGTH),
+ *           decoding just the blocks that hold them (needs a file
+ *           written with compress --blocks)
+ */
+int main(int argc, char *argv[]) {
+    const char *usage =
+        "Usage: decompress [--mmap] [--threads=N] [--range=OFFSET:LENGTH] "
+        "[input [output]]\n";
+
+    string inName = "compout";
+    string outName = "decompout";
+    bool useMmap = false;
+    size_t threads = 0;       // 0: one per core
+    bool useRange = false;
+    uint64_t rangeOffset = 0, rangeLength = 0;
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--mmap") {
+            useMmap = true;
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            if (!parseThreads(arg.substr(10), threads)) {
+                cerr << usage;
+                return 1;
+            }
+        } else if (arg.compare(0, 8, "--range=") == 0) {
+            useRange = true;
+            if (!parseRange(arg.substr(8), rangeOffset, rangeLength)) {
+                cerr << usage;
+                return 1;
+            }
+        } else if (positional == 0) {
+            inName = arg;
+            ++positional;
+        } else if (positional == 1) {
+            outName = arg;
+            ++positional;
+        } else {
+            cerr << usage;
+            return 1;
+        }
+    }
 
-int main() {
     /*
-     * Input and output files
-     * ----------------------
-     * "compout"   : compressed input file (text format, codes separated by spaces)
-     * "decompout" : decompressed output file (binary mode)
+     * Input and output streams
+     * ------------------------
+     * input  : compressed data (binary, see LZWFormat.h)
+     * output : decompressed data (binary)
      */
-    ifstream in("compout");
-    ofstream out("decompout", ios::binary);
+    StreamIO::ByteSource in(inName, useMmap);
+    StreamIO::ByteSink out(outName);
 
     // Check if input file opened successfully
     if (!in) {
-        cerr << "Cannot open compout.\n";
+        cerr << "Cannot open " << inName << ".\n";
         return 1;
     }
 
     // Check if output file opened successfully
     if (!out) {
-        cerr << "Cannot open decompout.\n";
+        cerr << "Cannot open " << outName << ".\n";
         return 1;
     }
 
     /*
-     * Dictionary
-     * ----------
-     * Stores strings indexed by their LZW codes.
-     * Size is fixed to MAX_CODES.
-     */
-    vector<string> dict(MAX_CODES);
-
-    /*
-     * Initialize dictionary with single-character ASCII strings
-     * Codes 0–255 correspond to standard ASCII characters.
+     * Header
+     * ------
+     * An empty file has nothing to decode; anything else must
+     * start with a valid container header.
      */
-    for (int i = 0; i < 256; ++i) {
-        dict[i] = string(1, static_cast<char>(i));
+    if (in.atEnd()) {
+        return in ? 0 : 1;
     }
 
-    // Next available dictionary code
-    int nextCode = FIRST_CODE;
-
-    /*
-     * Read the first code
-     * -------------------
-     * This initializes the decompression process.
-     */
-    int prevCode;
-    if (!(in >> prevCode)) {
-        // Empty input file
-        return 0;
+    LZWFormat::Header header;
+    if (!LZWFormat::readHeader(in, header)) {
+        cerr << inName << " is not a valid compressed file.\n";
+        return 1;
     }
 
-    // Output the string corresponding to the first code
-    string prevStr = dict[prevCode];
-    out << prevStr;
+    if (useRange) {
+        ThreadPool pool(threads);
+        if (!decompressRange(in, out, header, rangeOffset, rangeLength, pool))
+            return 1;
+    } else if (header.flags & LZWFormat::FLAG_BLOCKS) {
+        ThreadPool pool(threads);
+        if (!decompressBlocks(in, out, header, pool))
+            return 1;
+    } else {
+        // Single stream: feed the rest of the input chunk by chunk
+        LZW::Decompressor<StreamIO::ByteSink> decompressor(out, header);
 
-    /*
-     * Main decompression loop
-     * -----------------------
-     * Reads codes one by one and reconstructs the original data.
-     */
-    int currCode;
-    while (in >> currCode) {
-        string entry;
-
-        /*
-         * If the current code already exists in the dictionary,
-         * use the corresponding string.
-         */
-        if (!dict[currCode].empty()) {
-            entry = dict[currCode];
-        }
-        /*
-         * Special LZW case:
-         * If the code is not yet in the dictionary,
-         * the entry is previous string + its first character.
-         */
-        else {
-            entry = prevStr + prevStr[0];
-        }
+        const unsigned char *data;
+        size_t size;
+        while (in.next(data, size) && decompressor.update(data, size)) { }
 
-        // Write the decoded string to the output file
-        out << entry;
-
-        /*
-         * Add a new entry to the dictionary:
-         * previous string + first character of current entry
-         */
-        if (nextCode < MAX_CODES) {
-            string newStr = prevStr + entry[0];
-            dict[nextCode] = newStr;
-            nextCode++;
+        if (!decompressor.finish()) {
+            cerr << "Corrupt input: " << decompressor.lastError() << ".\n";
+            return 1;
         }
+    }
 
-        // Update previous string for the next iteration
-        prevStr = entry;
+    if (!in) {
+        cerr << "Error reading " << inName << ".\n";
+        return 1;
+    }
+    if (!out.flush()) {
+        cerr << "Error writing " << outName << ".\n";
+        return 1;
     }
 
     return 0;